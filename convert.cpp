@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <vector>
+
+#include "trace_format.h"
+
+using namespace std;
+
+// schedconv : converts a text input file or rand file to the binary format of trace_format.h
+// The text file is checked like sched does, so a malformed line is reported with its line number
+
+
+// Input file : every "AT TC CB IO" line becomes a record of 4 int32. Blank lines are skipped
+bool convert_input_file(const MappedFile& text_file, FILE* out) {
+    LineTokenizer tokenizer(text_file);
+    int values[4]; // at, totCPU, cpuB, ioB
+    int count_values;
+    int64_t number_records = 0;
+
+    // The header needs the number of records so we write it again at the end
+    write_binary_header(out, WORKLOAD_MAGIC, 0);
+    while ((count_values = tokenizer.next_line(values, 4)) != -1) {
+        if (count_values == 0) {
+            continue;
+        }
+        if (count_values != 4) {
+            printf("Malformed line %d in input file %s : expected AT TC CB IO\n", tokenizer.line_number, text_file.path.c_str());
+            return false;
+        }
+        int32_t record[4] = {values[0], values[1], values[2], values[3]};
+        fwrite(record, sizeof(record), 1, out);
+        number_records++;
+    }
+    rewind(out);
+    return write_binary_header(out, WORKLOAD_MAGIC, number_records);
+}
+
+// Rand file : the header line becomes the number of records and every random number a record of 1 int32
+bool convert_rand_file(const MappedFile& text_file, FILE* out) {
+    LineTokenizer tokenizer(text_file);
+    int value;
+    int count;
+
+    // Read first line where there is the total number of random numbers (blank lines are skipped)
+    while ((count = tokenizer.next_line(&value, 1)) == 0) {}
+    if (count < 0 || value == 0) {
+        printf("Malformed line %d in rand file %s : expected the number of random numbers\n", tokenizer.line_number, text_file.path.c_str());
+        return false;
+    }
+    int total_random_num = value;
+
+    write_binary_header(out, RANDOM_MAGIC, total_random_num);
+    int incr = 0;
+    while ((count = tokenizer.next_line(&value, 1)) != -1) {
+        if (count == -2) {
+            printf("Malformed line %d in rand file %s\n", tokenizer.line_number, text_file.path.c_str());
+            return false;
+        }
+        if (count == 1) {
+            if (incr == total_random_num) {
+                printf("Rand file %s has more than the %d random numbers of its header\n", text_file.path.c_str(), total_random_num);
+                return false;
+            }
+            int32_t record = value;
+            fwrite(&record, sizeof(record), 1, out);
+            incr++;
+        }
+    }
+    if (incr != total_random_num) {
+        printf("Rand file %s has %d random numbers but its header says %d\n", text_file.path.c_str(), incr, total_random_num);
+        return false;
+    }
+    return true;
+}
+
+
+int main(int argc, char *argv[]) {
+    int rflag = 0; // The text file is a rand file
+    int o;
+
+    opterr = 0;
+    while ((o = getopt (argc, argv, "r")) != -1) {
+        switch (o)
+        {
+        case 'r':
+            rflag = 1;
+            break;
+        case '?':
+            fprintf (stderr, "Unknown option '-%c'.\n", optopt);
+            return 1;
+        default:
+            abort ();
+        }
+    }
+
+    if (argc - optind != 2) { printf("Usage : schedconv [-r] text_file binary_file (-r for a rand file)\n"); return -1; }
+
+    if (!is_little_endian()) { printf("The binary format can only be written on a little-endian host\n"); return -1; }
+
+    MappedFile text_file;
+    if ( !text_file.open(argv[optind]) ) {cout<< "Could not open the text file \n"; return -1;}
+    FILE* out = fopen(argv[optind + 1], "wb");
+    if (out == NULL) {cout<< "Could not open the binary file \n"; return -1;}
+
+    bool success = rflag ? convert_rand_file(text_file, out) : convert_input_file(text_file, out);
+    if (fclose(out) != 0) {
+        success = false;
+    }
+    if (!success) {
+        remove(argv[optind + 1]);
+        return -1;
+    }
+    return 0;
+}
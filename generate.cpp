@@ -0,0 +1,230 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <iostream>
+#include <string>
+#include <random>
+
+#include "trace_format.h"
+
+using namespace std;
+
+// schedgen : generates synthetic input files for sched, in the text format or in the binary format of trace_format.h
+// The processes are written one by one so any number of processes can be generated with constant memory.
+// The distributions are computed from the raw output of mt19937_64 (not from the <random> distributions
+// whose results depend on the standard library) so a seed gives the same file everywhere
+
+
+// Uniform double in [0, 1) from the 53 high bits of the generator
+double uniform01(mt19937_64& generator) {
+    return (generator() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// A distribution given on the command line as <name>:<param>[:<param>]
+struct Distribution {
+    enum Kind {CONSTANT, UNIFORM, EXPONENTIAL, PARETO};
+    Kind kind;
+    double a = 0;
+    double b = 0;
+
+    // Parse "const:<v>", "uniform:<min>:<max>", "exp:<mean>" or "pareto:<alpha>:<min>". Returns false if the spec is not valid
+    bool parse(const string& spec) {
+        if (sscanf(spec.c_str(), "const:%lf", &a) == 1) {
+            kind = CONSTANT;
+            return a >= 0;
+        }
+        if (sscanf(spec.c_str(), "uniform:%lf:%lf", &a, &b) == 2) {
+            kind = UNIFORM;
+            return a >= 0 && a <= b;
+        }
+        if (sscanf(spec.c_str(), "exp:%lf", &a) == 1) {
+            kind = EXPONENTIAL;
+            return a > 0;
+        }
+        if (sscanf(spec.c_str(), "pareto:%lf:%lf", &a, &b) == 2) {
+            kind = PARETO;
+            return a > 0 && b > 0;
+        }
+        return false;
+    }
+
+    double sample(mt19937_64& generator) {
+        switch (kind) {
+            case CONSTANT : {
+                return a;
+            }
+            case UNIFORM : {
+                // Integer values so both bounds can be drawn
+                return a + floor(uniform01(generator) * (floor(b) - a + 1));
+            }
+            case EXPONENTIAL : {
+                return -a * log(1 - uniform01(generator));
+            }
+            case PARETO : {
+                // Heavy tail : P(X > x) = (min / x)^alpha
+                return b / pow(1 - uniform01(generator), 1 / a);
+            }
+        }
+        return 0;
+    }
+};
+
+// Gaps between two arrivals
+// poisson:<mean gap>, bursty:<mean burst size>:<mean gap in a burst>:<mean gap between bursts> or pareto:<alpha>:<min gap>
+struct ArrivalProcess {
+    enum Kind {POISSON, BURSTY, PARETO};
+    Kind kind;
+    double mean_gap = 0;
+    double burst_size = 0;
+    double burst_gap = 0;
+    double idle_gap = 0;
+    Distribution pareto;
+    int left_in_burst = 0; // Arrivals left in the current burst
+
+    bool parse(const string& spec) {
+        if (sscanf(spec.c_str(), "poisson:%lf", &mean_gap) == 1) {
+            kind = POISSON;
+            return mean_gap >= 0;
+        }
+        if (sscanf(spec.c_str(), "bursty:%lf:%lf:%lf", &burst_size, &burst_gap, &idle_gap) == 3) {
+            kind = BURSTY;
+            return burst_size >= 1 && burst_gap >= 0 && idle_gap >= 0;
+        }
+        if (spec.compare(0, 7, "pareto:") == 0) {
+            kind = PARETO;
+            return pareto.parse(spec);
+        }
+        return false;
+    }
+
+    double next_gap(mt19937_64& generator) {
+        switch (kind) {
+            case POISSON : {
+                return -mean_gap * log(1 - uniform01(generator));
+            }
+            case BURSTY : {
+                // Geometric burst sizes with exponential gaps inside a burst and between bursts
+                if (left_in_burst > 0) {
+                    left_in_burst--;
+                    return -burst_gap * log(1 - uniform01(generator));
+                }
+                left_in_burst = (int) floor(log(1 - uniform01(generator)) / log(1 - 1 / burst_size));
+                return -idle_gap * log(1 - uniform01(generator));
+            }
+            case PARETO : {
+                return pareto.sample(generator);
+            }
+        }
+        return 0;
+    }
+};
+
+// Bursts and the total CPU time must be at least 1 (sched draws random numbers modulo the bursts)
+int to_time(double value) {
+    if (value < 1) {
+        return 1;
+    }
+    if (value > INT_MAX) {
+        return INT_MAX;
+    }
+    return (int) value;
+}
+
+
+int main(int argc, char *argv[]) {
+    long long number_processes = 1000;
+    unsigned long long seed = 1;
+    string arrival_spec = "poisson:10";
+    string tc_spec = "uniform:50:500";
+    string cb_spec = "uniform:5:50";
+    string io_spec = "uniform:5:50";
+    int bflag = 0; // Binary output
+    int o;
+
+    opterr = 0;
+    while ((o = getopt (argc, argv, "n:s:a:t:c:i:b")) != -1) {
+        switch (o)
+        {
+        case 'n':
+            number_processes = atoll(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'a':
+            arrival_spec = optarg;
+            break;
+        case 't':
+            tc_spec = optarg;
+            break;
+        case 'c':
+            cb_spec = optarg;
+            break;
+        case 'i':
+            io_spec = optarg;
+            break;
+        case 'b':
+            bflag = 1;
+            break;
+        case '?':
+            if (isprint (optopt)) {
+                fprintf (stderr, "Unknown option '-%c' or missing argument.\n", optopt);
+            }
+            return 1;
+        default:
+            abort ();
+        }
+    }
+
+    if (argc - optind != 1) {
+        printf("Usage : schedgen [-n processes] [-s seed] [-a arrivals] [-t TC] [-c CB] [-i IO] [-b] output_file\n");
+        printf("  arrivals : poisson:<mean gap> | bursty:<mean burst size>:<mean gap in burst>:<mean gap between bursts> | pareto:<alpha>:<min gap>\n");
+        printf("  TC, CB, IO : const:<v> | uniform:<min>:<max> | exp:<mean> | pareto:<alpha>:<min>\n");
+        printf("  -b writes the binary format\n");
+        return -1;
+    }
+    if (number_processes < 0 || number_processes > INT_MAX) { printf("The number of processes must be between 0 and %d\n", INT_MAX); return -1; }
+
+    ArrivalProcess arrivals;
+    Distribution tc, cb, io;
+    if (!arrivals.parse(arrival_spec)) { printf("Invalid arrival process %s\n", arrival_spec.c_str()); return -1; }
+    if (!tc.parse(tc_spec)) { printf("Invalid TC distribution %s\n", tc_spec.c_str()); return -1; }
+    if (!cb.parse(cb_spec)) { printf("Invalid CB distribution %s\n", cb_spec.c_str()); return -1; }
+    if (!io.parse(io_spec)) { printf("Invalid IO distribution %s\n", io_spec.c_str()); return -1; }
+    if (bflag && !is_little_endian()) { printf("The binary format can only be written on a little-endian host\n"); return -1; }
+
+    FILE* out = fopen(argv[optind], bflag ? "wb" : "w");
+    if (out == NULL) {cout<< "Could not open the output file \n"; return -1;}
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+    if (bflag) {
+        write_binary_header(out, WORKLOAD_MAGIC, number_processes);
+    }
+
+    mt19937_64 generator(seed);
+    double arrival_time = 0;
+    for (long long i = 0; i < number_processes; i++) {
+        // The first process arrives at 0
+        if (i > 0) {
+            arrival_time += arrivals.next_gap(generator);
+        }
+        if (arrival_time > INT_MAX) {
+            printf("Arrival time of process %lld is too large, use smaller gaps\n", i);
+            fclose(out);
+            remove(argv[optind]);
+            return -1;
+        }
+        int32_t record[4] = {(int32_t) arrival_time, to_time(tc.sample(generator)), to_time(cb.sample(generator)), to_time(io.sample(generator))};
+        if (bflag) {
+            fwrite(record, sizeof(record), 1, out);
+        }
+        else {
+            fprintf(out, "%d %d %d %d\n", record[0], record[1], record[2], record[3]);
+        }
+    }
+
+    if (fclose(out) != 0) {cout<< "Could not write the output file \n"; return -1;}
+    return 0;
+}
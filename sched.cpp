@@ -1,7 +1,13 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
 #include <unistd.h>
+#include <sys/resource.h>
 
 #include <iostream>
 #include <fstream>
@@ -9,13 +15,128 @@
 #include <queue>
 #include <stack>
 #include <map>
+#include <set>
+#include <deque>
 #include <list>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <chrono>
+
+#include "trace_format.h"
 
 using namespace std;
 
 
+//-------------------- STEP 0 : Memory pools --------------------
+// Processes and events are created at a high rate so we don't ask malloc for them one by one.
+// A Pool hands out objects from big contiguous slabs and recycles the released objects through a free list,
+// so the memory used is bounded by the maximum number of objects alive at the same time.
+// Each thread has its own pool so parallel simulations don't share anything. An object must be released by the thread
+// that allocated it, before that thread exits : the slabs of a thread are given back to the system when it exits.
+template <typename T, int SLAB_SIZE>
+class Pool {
+    public:
+        static void* allocate() {
+            // Reuse a released object first
+            if (free_list != nullptr) {
+                FreeNode* node = free_list;
+                free_list = node->next;
+                return node;
+            }
+            // Else we take the next object of the current slab (and get a new slab if it is full)
+            if (slab_cursor == slab_end) {
+                slab_cursor = static_cast<char*>(::operator new(SLAB_SIZE * sizeof(T)));
+                slabs.slabs.push_back(slab_cursor);
+                slab_end = slab_cursor + SLAB_SIZE * sizeof(T);
+            }
+            void* ptr = slab_cursor;
+            slab_cursor += sizeof(T);
+            return ptr;
+        }
+
+        static void release(void* ptr) {
+            FreeNode* node = static_cast<FreeNode*>(ptr);
+            node->next = free_list;
+            free_list = node;
+        }
+
+    private:
+        // A released object is reused as a node of the free list
+        struct FreeNode {
+            FreeNode* next;
+        };
+        // The slabs of the thread, freed when the thread exits (only touched when a slab is taken so allocate stays cheap)
+        struct Slabs {
+            vector<char*> slabs;
+            ~Slabs() {
+                for (size_t i = 0; i < slabs.size(); i++) {
+                    ::operator delete(slabs[i]);
+                }
+                free_list = nullptr;
+                slab_cursor = nullptr;
+                slab_end = nullptr;
+            }
+        };
+        static thread_local FreeNode* free_list;
+        static thread_local char* slab_cursor;
+        static thread_local char* slab_end;
+        static thread_local Slabs slabs;
+};
+
+template <typename T, int SLAB_SIZE>
+thread_local typename Pool<T, SLAB_SIZE>::FreeNode* Pool<T, SLAB_SIZE>::free_list = nullptr;
+template <typename T, int SLAB_SIZE>
+thread_local char* Pool<T, SLAB_SIZE>::slab_cursor = nullptr;
+template <typename T, int SLAB_SIZE>
+thread_local char* Pool<T, SLAB_SIZE>::slab_end = nullptr;
+template <typename T, int SLAB_SIZE>
+thread_local typename Pool<T, SLAB_SIZE>::Slabs Pool<T, SLAB_SIZE>::slabs;
+
+// Allocator of the node based containers of the schedulers (std::set nodes of CFS) : single nodes come from a Pool
+template <typename T>
+struct PoolAllocator {
+    typedef T value_type;
+
+    PoolAllocator() {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        if (n == 1) {
+            return static_cast<T*>(Pool<T, 4096>::allocate());
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        if (n == 1) {
+            Pool<T, 4096>::release(ptr);
+        }
+        else {
+            ::operator delete(ptr);
+        }
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+    return false;
+}
+
+
 //-------------------- STEP 1 : Create Processes objects --------------------
 // First we write the Process class and the input reader function that builds the Process queue
+struct Event;
+class CFS;
 struct Process {
 
     // Input attributes
@@ -34,12 +155,19 @@ struct Process {
     int remainingBurstTime; // remaining CPU burst time in case of preemption. Used to check if the process comes from preemption
     int clock; // dynamic clock of the process
     int stopRunningTime; // Time when the process will stop being run. Needed for E scheduler preemption test
+    Event* pending_event; // The unique future event of the process in the DES layer (nullptr if none). Needed to cancel it on E scheduler preemption
+    int core; // Core the process runs on, or last ran on (always 0 with a single CPU)
+    long long vruntime; // CFS only : weighted CPU time received, in 1/1024 of time unit
+    double dispatchCPUtime; // CFS only : remainingCPUtime when the process was last picked (-1 if it never ran)
+    CFS* cfs_queue; // CFS only : run queue the process was last picked from (nullptr if it never ran)
+    long long boost_epoch; // MLFQ only : number of boosts of the scheduler when dynamic_prio was set (-1 if never set)
 
     // Output attributes
     int finishingTime;
     int turnaroundTime;
     int ioWaitingTime; // Time in Block state. Dynamically updated
     int cpuWaitingTime; // Time in Ready state. Dynamically updated
+    bool done; // True once the process reached the DONE state. Needed to print its summary line during the simulation
 
     Process(int pid_, int at, int totCPU, int cpuB, int ioB) {
         pid = pid_;
@@ -55,11 +183,27 @@ struct Process {
         turnaroundTime = 0;
         ioWaitingTime = 0; 
         cpuWaitingTime = 0;
+        done = false;
 
         remainingCPUtime = totalCPUTime;
         remainingBurstTime = -1;
         clock = 0; 
         stopRunningTime = -1;
+        pending_event = nullptr;
+        core = 0;
+        vruntime = 0;
+        dispatchCPUtime = -1;
+        cfs_queue = nullptr;
+        boost_epoch = -1;
+    }
+
+    // Processes are allocated in the process pool (see STEP 0)
+    static void* operator new(size_t size) {
+        return Pool<Process, 4096>::allocate();
+    }
+
+    static void operator delete(void* ptr) {
+        Pool<Process, 4096>::release(ptr);
     }
 
 };
@@ -73,15 +217,31 @@ class Scheduler {
         // pure virtual function providing interface framework.
         virtual void add_process(Process* process) = 0;
         virtual Process* get_next_process() = 0;
-        virtual void print_scheduler() = 0;
+        virtual void print_scheduler(FILE* out) = 0;
         virtual bool test_preempt(Process* running_process, Process* process, int curr_time) = 0;
-        bool preprio_flag = false; // True only for preprio scheduler. Used to check if preemption is possible when a new process becomes READY
+        virtual size_t size() = 0; // Number of READY processes
+        // Longest cpu burst the process may run before being preempted. CFS and MLFQ give a different slice to each process
+        virtual int time_slice(Process* process) {
+            return quantum;
+        }
+        // True only for preprio scheduler. Used to check if preemption is possible when a new process becomes READY.
+        // It is a compile time constant hidden by PREPRIO so the loops of the other schedulers don't test it
+        static const bool preemptive = false;
         int quantum = 10000;
         int maxprio= 4;
+
+        // MLFQ only : the simulation loop puts a boost event in the DES layer every boost_period and calls boost().
+        // periodic_boost is hidden by the schedulers that need it so the other loops don't test for boost events
+        static const bool periodic_boost = false;
+        int boost_period = 0;
+        long long number_boosts = 0;
+        virtual void boost() {}
+
+        virtual ~Scheduler() {}
         
 };
 
-class FCFS: public Scheduler {
+class FCFS final: public Scheduler {
     public:
         queue<Process*> ready_processes; // FIFO queue
 
@@ -104,15 +264,19 @@ class FCFS: public Scheduler {
             return false;
         }
 
-        void print_scheduler() {
-            cout << "FCFS" << endl;
+        void print_scheduler(FILE* out) {
+            fprintf(out, "FCFS\n");
+        }
+
+        size_t size() {
+            return ready_processes.size();
         }
 
         FCFS():Scheduler() {}
 
 };
 
-class LCFS: public Scheduler {
+class LCFS final: public Scheduler {
     public:
         stack<Process*> ready_processes; // LIFO queue
 
@@ -130,8 +294,12 @@ class LCFS: public Scheduler {
             }
         }
 
-        void print_scheduler() {
-            cout << "LCFS" << endl;
+        void print_scheduler(FILE* out) {
+            fprintf(out, "LCFS\n");
+        }
+
+        size_t size() {
+            return ready_processes.size();
         }
 
         // For E scheduler only
@@ -143,42 +311,55 @@ class LCFS: public Scheduler {
 
 };
 
-class SRTF: public Scheduler {
+class SRTF final: public Scheduler {
     public:
-        // Linked list of Processes where the head is the process with shortest cpu time remaining
-        list<Process*> ready_processes; 
-
-        void add_process(Process* process) { 
-            std::list<Process*>::iterator it = ready_processes.begin();
-            while(it != ready_processes.end()) {
-                // We use large inequalities to make sure we respect the order of arrival of the processes in the ready queue
-                // (Deterministic Behavior rule)
-                if ((*it)->remainingCPUtime <= process->remainingCPUtime) {
-                    it++;
-                } else {
-                    ready_processes.insert(it, process);
-                    return;
+        // Entry of the ready queue. The key is copied at insertion time
+        struct ReadyEntry {
+            double remainingCPUtime;
+            long long seq; // order of arrival in the ready queue
+            Process* process;
+        };
+
+        // Order of the min-heap : shortest remaining time first, then order of arrival
+        // We respect the order of arrival of the processes with the same remaining time (Deterministic Behavior rule)
+        struct LaterEntry {
+            bool operator()(const ReadyEntry& a, const ReadyEntry& b) const {
+                if (a.remainingCPUtime != b.remainingCPUtime) {
+                    return a.remainingCPUtime > b.remainingCPUtime;
                 }
+                return a.seq > b.seq;
             }
+        };
+
+        // Min-heap of Processes where the top is the process with shortest cpu time remaining
+        priority_queue<ReadyEntry, vector<ReadyEntry>, LaterEntry> ready_processes; 
+        long long next_seq = 0;
 
-            // If we are here, it means we didn't insert the process so it must have the largest remaining time of the list of ready processes
-            // ==> We add it at the back
-            ready_processes.push_back(process);
+        void add_process(Process* process) { 
+            ReadyEntry entry;
+            entry.remainingCPUtime = process->remainingCPUtime;
+            entry.seq = next_seq++;
+            entry.process = process;
+            ready_processes.push(entry);
         }
 
         Process* get_next_process() {
             if (ready_processes.empty()) {
                 return nullptr;
             } else {
-                // By construction of the linked list ready_processes, the shortest remaining time process is in the front
-                Process* next_process = ready_processes.front();
-                ready_processes.pop_front();
+                // By construction of the heap ready_processes, the shortest remaining time process is on top
+                Process* next_process = ready_processes.top().process;
+                ready_processes.pop();
                 return next_process;
             }
         }
 
-        void print_scheduler() {
-            cout << "SRTF" << endl;
+        void print_scheduler(FILE* out) {
+            fprintf(out, "SRTF\n");
+        }
+
+        size_t size() {
+            return ready_processes.size();
         }
 
         // For E scheduler only
@@ -190,7 +371,7 @@ class SRTF: public Scheduler {
 
 };
 
-class RR: public Scheduler {
+class RR final: public Scheduler {
     public:
         queue<Process*> ready_processes; // FIFO queue
 
@@ -208,8 +389,12 @@ class RR: public Scheduler {
             }
         }
 
-        void print_scheduler() {
-            cout << "RR " << quantum << endl;
+        void print_scheduler(FILE* out) {
+            fprintf(out, "RR %d\n", quantum);
+        }
+
+        size_t size() {
+            return ready_processes.size();
         }
 
         // For E scheduler only
@@ -223,10 +408,171 @@ class RR: public Scheduler {
 
 };
 
-class PRIO: public Scheduler {
+// FIFO ring buffer of processes. The capacity is a power of 2 and doubles when the buffer is full
+class ProcessRing {
+    public:
+        bool empty() {
+            return count == 0;
+        }
+
+        size_t size() {
+            return count;
+        }
+
+        void push(Process* process) {
+            if (count == buffer.size()) {
+                grow();
+            }
+            buffer[(head + count) & (buffer.size() - 1)] = process;
+            count++;
+        }
+
+        Process* pop() {
+            Process* process = buffer[head];
+            head = (head + 1) & (buffer.size() - 1);
+            count--;
+            return process;
+        }
+
+    private:
+        vector<Process*> buffer;
+        size_t head = 0; // index of the front process
+        size_t count = 0; // number of processes in the buffer
+
+        void grow() {
+            // Copy the processes in order at the beginning of a buffer twice as big
+            vector<Process*> new_buffer(buffer.empty() ? 4 : 2 * buffer.size());
+            for (size_t i = 0; i < count; i++) {
+                new_buffer[i] = buffer[(head + i) & (buffer.size() - 1)];
+            }
+            buffer.swap(new_buffer);
+            head = 0;
+        }
+};
+
+// One FIFO per priority level and an occupancy bitmap to find the highest non-empty level in O(1) (like the Linux O(1) scheduler)
+// The bit of a level is set when its FIFO is not empty.
+// The bitmap is hierarchical : a bit of layer k+1 is set when the corresponding 64 bits word of layer k is not 0.
+// The top layer is a single word so finding the highest level is one count-leading-zeros per layer
+class PrioQueues {
+    public:
+        bool empty() {
+            return bitmap.back()[0] == 0;
+        }
+
+        // O(number of levels). Only used by the -S counters
+        size_t size() {
+            size_t total = 0;
+            for (size_t level = 0; level < levels.size(); level++) {
+                total += levels[level].size();
+            }
+            return total;
+        }
+
+        void push(int level, Process* process) {
+            if (levels[level].empty()) {
+                set_bit(level);
+            }
+            levels[level].push(process);
+        }
+
+        // Pop the front process of the highest non-empty level. nullptr if there is none
+        Process* pop_highest() {
+            if (empty()) {
+                return nullptr;
+            }
+            int level = highest_level();
+            Process* process = levels[level].pop();
+            if (levels[level].empty()) {
+                clear_bit(level);
+            }
+            return process;
+        }
+
+        PrioQueues(int number_levels) {
+            levels.resize(number_levels);
+            // Build the layers of the bitmap until one word is enough
+            size_t words = (number_levels + 63) / 64;
+            bitmap.push_back(vector<unsigned long long>(words, 0));
+            while (words > 1) {
+                words = (words + 63) / 64;
+                bitmap.push_back(vector<unsigned long long>(words, 0));
+            }
+        }
+
+    private:
+        vector<ProcessRing> levels;
+        vector<vector<unsigned long long>> bitmap; // bitmap[0] has one bit per level, bitmap.back() has one word
+
+        void set_bit(int index) {
+            for (size_t layer = 0; layer < bitmap.size(); layer++) {
+                unsigned long long& word = bitmap[layer][index / 64];
+                bool was_empty = (word == 0);
+                word |= 1ULL << (index % 64);
+                // The upper layers already know this word is not empty
+                if (!was_empty) {
+                    return;
+                }
+                index /= 64;
+            }
+        }
+
+        void clear_bit(int index) {
+            for (size_t layer = 0; layer < bitmap.size(); layer++) {
+                unsigned long long& word = bitmap[layer][index / 64];
+                word &= ~(1ULL << (index % 64));
+                // The word still has bits set so the upper layers don't change
+                if (word != 0) {
+                    return;
+                }
+                index /= 64;
+            }
+        }
+
+        int highest_level() {
+            // Go down from the top layer, always following the highest bit set
+            int index = 0;
+            for (int layer = bitmap.size() - 1; layer >= 0; layer--) {
+                unsigned long long word = bitmap[layer][index];
+                index = index * 64 + (63 - __builtin_clzll(word));
+            }
+            return index;
+        }
+};
+
+// PRIO and PREPRIO are the same multilevel queue scheduler. They only differ by their preemption policy,
+// which is a template parameter so the preemption test is resolved at compile time
+struct NoPreemption {
+    static const bool preemptive = false;
+    static const char* name() {
+        return "PRIO";
+    }
+    // A new READY process never preempts the running process
+    static bool test_preempt(Process* CURRENT_RUNNING_PROCESS, Process* process, int CURRENT_TIME) {
+        return false;
+    }
+};
+
+struct PriorityPreemption {
+    static const bool preemptive = true;
+    static const char* name() {
+        return "PREPRIO";
+    }
+    // A new READY process preempts the running process if it has a higher priority 
+    // and if the running process wasn't going to stop now
+    static bool test_preempt(Process* CURRENT_RUNNING_PROCESS, Process* process, int CURRENT_TIME) {
+        bool prioTestPreemption = CURRENT_RUNNING_PROCESS->dynamic_prio < process->dynamic_prio;
+        bool timeTestPreemption = CURRENT_TIME < CURRENT_RUNNING_PROCESS->stopRunningTime;
+        return (prioTestPreemption && timeTestPreemption);
+    }
+};
+
+template <typename PreemptionPolicy>
+class MultiLevelScheduler final: public Scheduler {
     public:
-        vector<queue<Process*>>* activeQ = new vector<queue<Process*>>(); // POINTER to the active queue
-        vector<queue<Process*>>* expiredQ = new vector<queue<Process*>>(); // POINTER to the expired queue
+        static const bool preemptive = PreemptionPolicy::preemptive;
+        PrioQueues* activeQ; // POINTER to the active queue
+        PrioQueues* expiredQ; // POINTER to the expired queue
 
         void add_process(Process* process) {
             // First we check if the process comes from preemption
@@ -238,7 +584,7 @@ class PRIO: public Scheduler {
                     // ... We reset the dynamic priority to the static priority - 1 ...
                     process->dynamic_prio = process->static_prio - 1;
                     // ... and we add the process to the expiredQ
-                    (*expiredQ)[process->dynamic_prio].push(process);
+                    expiredQ->push(process->dynamic_prio, process);
                     // End of add_process in this case so we return
                     return;
                 }
@@ -249,40 +595,145 @@ class PRIO: public Scheduler {
                 process->dynamic_prio = process->static_prio - 1;
             }
             // Finally, we add the process to the active Queue (we dealt with the case of expired queue before)
-            (*activeQ)[process->dynamic_prio].push(process);
+            activeQ->push(process->dynamic_prio, process);
         }
 
         Process* get_next_process() {
 
-            Process* next_process = nullptr;
-            // We iterate through the active queue vector ot find the next process
-            for (vector<queue<Process*>>::reverse_iterator it = (*activeQ).rbegin(); it != (*activeQ).rend(); it++) {
-                if (!(*it).empty()) {
-                    next_process = (*it).front();
-                    (*it).pop();
-                    return next_process;
-                }
+            // If we have no processes left in active queue, we swap the active and expired queue
+            // (the -S counters see the swaps before the call, see SimulationStats::next_process)
+            if (activeQ->empty()) {
+                swap(activeQ, expiredQ);
             }
 
-            // If we are here, it means we have no processes left in active queue so we swap the active and expired queue
-            swap(activeQ, expiredQ);
+            // The bitmap gives the highest priority non-empty level directly
+            // If the new active queue is empty too, we have no more processes and it returns null pointer
+            return activeQ->pop_highest();
 
-            // And now we iterate again in the new active queue
-            for (vector<queue<Process*>>::reverse_iterator it = (*activeQ).rbegin(); it != (*activeQ).rend(); it++) {
-                if (!(*it).empty()) {
-                    next_process = (*it).front();
-                    (*it).pop();
-                    return next_process;
+        }
+
+        // For E scheduler only
+        bool test_preempt(Process* CURRENT_RUNNING_PROCESS, Process* process, int CURRENT_TIME) {
+            return PreemptionPolicy::test_preempt(CURRENT_RUNNING_PROCESS, process, CURRENT_TIME);
+        }
+
+        void print_scheduler(FILE* out) {
+            fprintf(out, "%s %d\n", PreemptionPolicy::name(), quantum);
+        }
+
+        size_t size() {
+            return activeQ->size() + expiredQ->size();
+        }
+
+        MultiLevelScheduler(int quantum_, int maxprio_):Scheduler() {
+            quantum = quantum_;
+            maxprio = maxprio_;
+
+            // We initialize the active and expired queues with maxprio empty levels
+            activeQ = new PrioQueues(maxprio);
+            expiredQ = new PrioQueues(maxprio);
+        }
+
+        ~MultiLevelScheduler() {
+            delete activeQ;
+            delete expiredQ;
+        }
+
+};
+
+typedef MultiLevelScheduler<NoPreemption> PRIO;
+typedef MultiLevelScheduler<PriorityPreemption> PREPRIO;
+
+// Completely Fair Scheduler (like Linux CFS) : the ready processes are ordered by virtual runtime, the CPU time
+// they received divided by their weight, and the process with the smallest vruntime runs next.
+// The weight comes from the static priority (one nice level per priority, nice 0 for priority 1) so a higher priority
+// process gets a bigger share of the CPU. Every ready process should run once per target_latency : the time slice
+// of a process is its share of target_latency (of nr_running * min_granularity if there are too many processes),
+// never less than min_granularity.
+// The ready set is a std::set (a red-black tree) so add_process and get_next_process are O(log n)
+class CFS final: public Scheduler {
+    public:
+        // Key of the tree. seq keeps the order of arrival of the processes with the same vruntime (Deterministic Behavior rule)
+        struct ReadyEntry {
+            long long vruntime;
+            long long seq;
+            Process* process;
+
+            bool operator<(const ReadyEntry& other) const {
+                if (vruntime != other.vruntime) {
+                    return vruntime < other.vruntime;
                 }
+                return seq < other.seq;
             }
+        };
+
+        set<ReadyEntry, less<ReadyEntry>, PoolAllocator<ReadyEntry>> ready_processes;
+        long long next_seq = 0;
+        long long total_weight = 0; // Sum of the weights of the ready processes
+        long long min_vruntime = 0; // Never decreases. New and woken up processes are placed relative to it
+        int target_latency;
+        int min_granularity;
+
+        // Weight of nice 0. The vruntime of a nice 0 process grows like the real time
+        static const long long NICE_0_WEIGHT = 1024;
+
+        // Weights of the nice levels 0 to -19 of Linux (sched_prio_to_weight) : each level gets about 25% more CPU
+        static long long weight(Process* process) {
+            static const long long weights[20] = {1024, 1277, 1586, 1991, 2501, 3121, 3906, 4904, 6100, 7620,
+                                                  9548, 11916, 14949, 18705, 23254, 29154, 36291, 46273, 56483, 71755};
+            return weights[min(process->static_prio - 1, 19)];
+        }
 
-            // If we are here, it means we have no more processes in the active and expired queue so we return null pointer
-            return nullptr;
+        void add_process(Process* process) {
+            // The process ran since it was picked : charge the CPU time it received, scaled by its weight
+            if (process->dispatchCPUtime >= 0) {
+                long long ran = (long long) (process->dispatchCPUtime - process->remainingCPUtime);
+                process->vruntime += ran * NICE_0_WEIGHT * NICE_0_WEIGHT / weight(process);
+            }
+            // A new process starts at min_vruntime. A process that comes from another core (-c) keeps its place relative
+            // to the min_vruntime of the run queue it leaves, as the min_vruntime of the cores drift apart (like the migration in Linux).
+            // A process that comes back from BLOCKED keeps its vruntime but is not allowed to be more than half a target latency behind,
+            // so a long sleep doesn't give it the CPU for a long time. A preempted process keeps its vruntime
+            if (process->dispatchCPUtime < 0) {
+                process->vruntime = min_vruntime;
+            }
+            else {
+                if (process->cfs_queue != this) {
+                    process->vruntime += min_vruntime - process->cfs_queue->min_vruntime;
+                }
+                if (process->remainingBurstTime <= 0) {
+                    process->vruntime = max(process->vruntime, min_vruntime - target_latency * NICE_0_WEIGHT / 2);
+                }
+            }
+
+            ReadyEntry entry;
+            entry.vruntime = process->vruntime;
+            entry.seq = next_seq++;
+            entry.process = process;
+            ready_processes.insert(entry);
+            total_weight += weight(process);
+        }
 
+        Process* get_next_process() {
+            if (ready_processes.empty()) {
+                return nullptr;
+            }
+            // The leftmost node is cached by the tree so begin() is O(1) and erasing it is O(log n) at most
+            Process* next_process = ready_processes.begin()->process;
+            ready_processes.erase(ready_processes.begin());
+            total_weight -= weight(next_process);
+            min_vruntime = max(min_vruntime, next_process->vruntime);
+            next_process->dispatchCPUtime = next_process->remainingCPUtime;
+            next_process->cfs_queue = this;
+            return next_process;
         }
 
-        void print_scheduler() {
-            cout << "PRIO " << quantum << endl;
+        // The slice is computed when the process starts running, with the ready processes of its run queue
+        int time_slice(Process* process) {
+            long long nr_running = ready_processes.size() + 1;
+            long long period = max((long long) target_latency, nr_running * min_granularity);
+            long long slice = period * weight(process) / (total_weight + weight(process));
+            return (int) max(slice, (long long) min_granularity);
         }
 
         // For E scheduler only
@@ -290,132 +741,205 @@ class PRIO: public Scheduler {
             return false;
         }
 
-        PRIO(int quantum_, int maxprio_):Scheduler() {
-            quantum = quantum_;
-            maxprio = maxprio_;
+        void print_scheduler(FILE* out) {
+            fprintf(out, "CFS %d:%d\n", target_latency, min_granularity);
+        }
 
-            // We initialize the vectors of queue with empty queues
-            for (int i = 0; i < maxprio; i++) {
-                activeQ->push_back(queue<Process*>());
-                expiredQ->push_back(queue<Process*>());
-            }
+        size_t size() {
+            return ready_processes.size();
+        }
+
+        CFS(int target_latency_, int min_granularity_):Scheduler() {
+            target_latency = target_latency_;
+            min_granularity = min_granularity_;
         }
 
 };
 
-class PREPRIO: public Scheduler {
+// Multilevel feedback queue : one FIFO per level, the top level has the shortest quantum (2, 4, 8 and 16 by default).
+// A new process starts at the top level. A process that uses its whole quantum goes down one level and a process that
+// blocks before the end of its quantum (IO-bound) goes up one level. Every boost_period a boost event of the DES layer
+// moves every process back to the top level so the CPU-bound processes at the bottom don't starve.
+// The boost splices the FIFOs of the lower levels at the end of the top one, so it is O(levels) whatever the number of
+// ready processes. The levels of the processes are updated lazily : a process whose boost_epoch is older than the last
+// boost is at the top level.
+// dynamic_prio is the level of the process, number_levels - 1 being the top level (higher is better like in PRIO)
+class MLFQ final: public Scheduler {
     public:
-        vector<queue<Process*>>* activeQ = new vector<queue<Process*>>(); // POINTER to the active queue
-        vector<queue<Process*>>* expiredQ = new vector<queue<Process*>>(); // POINTER to the expired queue
+        static const bool periodic_boost = true;
+
+        vector<int> quanta; // Quantum of each level, indexed by dynamic_prio
+        vector<list<Process*, PoolAllocator<Process*>>> levels; // FIFO of each level, indexed by dynamic_prio
+        size_t number_ready = 0;
+
+        int top_level() {
+            return levels.size() - 1;
+        }
+
+        // Level of the process, taking the boosts since it was set into account
+        int level(Process* process) {
+            if (process->boost_epoch != number_boosts) {
+                process->dynamic_prio = top_level();
+                process->boost_epoch = number_boosts;
+            }
+            return process->dynamic_prio;
+        }
 
         void add_process(Process* process) {
-            // First we check if the process comes from preemption
-            if (process->remainingBurstTime > 0) {
-                // If preemption, we decrease the dynamic priority
-                process->dynamic_prio--;
-                // If the dynamic priority is -1 ...
-                if (process->dynamic_prio == -1) {
-                    // ... We reset the dynamic priority to the static priority - 1 ...
-                    process->dynamic_prio = process->static_prio - 1;
-                    // ... and we add the process to the expiredQ
-                    (*expiredQ)[process->dynamic_prio].push(process);
-                    // End of add_process in this case so we return
-                    return;
-                }
+            if (process->boost_epoch < 0) {
+                // New process : the boost puts it at the top level
+                level(process);
+            }
+            else if (process->remainingBurstTime > 0) {
+                // Preempted at the end of its quantum : one level down
+                process->dynamic_prio = max(level(process) - 1, 0);
             }
             else {
-                // If no preemption, it means the process comes from CREATED or BLOCKED 
-                // so we reset its dynamic prio to his static prio - 1
-                process->dynamic_prio = process->static_prio - 1;
+                // Comes back from BLOCKED : it gave up the CPU before the end of its quantum so one level up
+                process->dynamic_prio = min(level(process) + 1, top_level());
             }
-            // Finally, we add the process to the active Queue (we dealt with the case of expired queue before)
-            (*activeQ)[process->dynamic_prio].push(process);
+            levels[process->dynamic_prio].push_back(process);
+            number_ready++;
         }
 
         Process* get_next_process() {
-
-            Process* next_process = nullptr;
-            // We iterate through the active queue vector ot find the next process
-            for (vector<queue<Process*>>::reverse_iterator it = (*activeQ).rbegin(); it != (*activeQ).rend(); it++) {
-                if (!(*it).empty()) {
-                    next_process = (*it).front();
-                    (*it).pop();
+            // The front process of the highest non-empty level
+            for (int prio = top_level(); prio >= 0; prio--) {
+                if (!levels[prio].empty()) {
+                    Process* next_process = levels[prio].front();
+                    levels[prio].pop_front();
+                    number_ready--;
+                    level(next_process);
                     return next_process;
                 }
             }
+            return nullptr;
+        }
 
-            // If we are here, it means we have no processes left in active queue so we swap the active and expired queue
-            swap(activeQ, expiredQ);
+        int time_slice(Process* process) {
+            return quanta[level(process)];
+        }
 
-            // And now we iterate again in the new active queue
-            for (vector<queue<Process*>>::reverse_iterator it = (*activeQ).rbegin(); it != (*activeQ).rend(); it++) {
-                if (!(*it).empty()) {
-                    next_process = (*it).front();
-                    (*it).pop();
-                    return next_process;
-                }
+        // Every ready process goes to the top level, after the processes already there and in order of level
+        void boost() {
+            for (int prio = top_level() - 1; prio >= 0; prio--) {
+                levels[top_level()].splice(levels[top_level()].end(), levels[prio]);
             }
-
-            // If we are here, it means we have no more processes in the active and expired queue so we return null pointer
-            return nullptr;
-
+            number_boosts++;
         }
 
         // For E scheduler only
-        bool test_preempt(Process* CURRENT_RUNNING_PROCESS, Process* process, int CURRENT_TIME) {
-            bool prioTestPreemption = CURRENT_RUNNING_PROCESS->dynamic_prio < process->dynamic_prio;
-            bool timeTestPreemption = CURRENT_TIME < CURRENT_RUNNING_PROCESS->stopRunningTime;
-            return (prioTestPreemption && timeTestPreemption);
+        bool test_preempt(Process* running_process, Process* process, int curr_time){
+            return false;
         }
 
-        void print_scheduler() {
-            cout << "PREPRIO " << quantum << endl;
+        void print_scheduler(FILE* out) {
+            fprintf(out, "MLFQ");
+            for (int prio = top_level(); prio >= 0; prio--) {
+                fprintf(out, prio == top_level() ? " %d" : ",%d", quanta[prio]);
+            }
+            fprintf(out, ":%d\n", boost_period);
         }
 
-        PREPRIO(int quantum_, int maxprio_):Scheduler() {
-            quantum = quantum_;
-            maxprio = maxprio_;
-            preprio_flag = true;
+        size_t size() {
+            return number_ready;
+        }
 
-            // We initialize the vectors of queue with empty queues
-            for (int i = 0; i < maxprio; i++) {
-                activeQ->push_back(queue<Process*>());
-                expiredQ->push_back(queue<Process*>());
-            }
+        // quanta_ gives the quantum of each level from the top level to the bottom one
+        MLFQ(const vector<int>& quanta_, int boost_period_):Scheduler() {
+            quanta.assign(quanta_.rbegin(), quanta_.rend());
+            levels.resize(quanta.size());
+            boost_period = boost_period_;
         }
 
 };
 
-//-------------------- STEP 3 : Create random number array and random number function --------------------
 
-int* random_nums; // This array will store all the random numbers
+//-------------------- STEP 3 : Read the files, create random number array and random number function --------------------
+// The input file and the rand file are mapped in memory (see trace_format.h). Text files are parsed with a hand-rolled integer tokenizer
+// (no locale, no istream) because parsing dominates the startup on big files. Binary files are read in place
+
+// The array is loaded once and then only read, so it is shared by every simulation
+const int* random_nums; // This array will store all the random numbers
 int total_random_num;
-void initialize_random_array(istream& rand_file){
+// The first line is the total number of random numbers, then there is one random number per line
+// A binary rand file is used in place, so rand_file must stay mapped during the simulations
+// Returns false (after printing the reason) if the file doesn't follow this format
+bool initialize_random_array(const MappedFile& rand_file){
+
+    if (is_binary_file(rand_file, RANDOM_MAGIC)) {
+        int64_t number_records;
+        random_nums = binary_records(rand_file, 1, number_records);
+        if (random_nums == nullptr) {
+            return false;
+        }
+        if (number_records == 0 || number_records > INT_MAX) {
+            printf("Binary rand file %s must have between 1 and %d random numbers\n", rand_file.path.c_str(), INT_MAX);
+            return false;
+        }
+        // Same condition as the text tokenizer, which doesn't read negative numbers
+        for (int64_t i = 0; i < number_records; i++) {
+            if (random_nums[i] < 0) {
+                printf("Malformed record %lld in rand file %s : negative value\n", (long long) i + 1, rand_file.path.c_str());
+                return false;
+            }
+        }
+        total_random_num = number_records;
+        return true;
+    }
+
+    LineTokenizer tokenizer(rand_file);
+    int value;
+    int count;
 
-    rand_file >> total_random_num; // Read first line where there is the total number of random numbers
+    // Read first line where there is the total number of random numbers (blank lines are skipped)
+    while ((count = tokenizer.next_line(&value, 1)) == 0) {}
+    if (count < 0 || value == 0) {
+        printf("Malformed line %d in rand file %s : expected the number of random numbers\n", tokenizer.line_number, rand_file.path.c_str());
+        return false;
+    }
+    total_random_num = value;
 
-    random_nums = new int[total_random_num] ;
-    int curr_num;
+    int* numbers = new int[total_random_num] ;
+    random_nums = numbers;
     int incr = 0;
-    while (rand_file >> curr_num) {
-        random_nums[incr] = curr_num;
-        incr++;
+    while ((count = tokenizer.next_line(&value, 1)) != -1) {
+        if (count == -2) {
+            printf("Malformed line %d in rand file %s\n", tokenizer.line_number, rand_file.path.c_str());
+            return false;
+        }
+        if (count == 1) {
+            if (incr == total_random_num) {
+                printf("Rand file %s has more than the %d random numbers of its header\n", rand_file.path.c_str(), total_random_num);
+                return false;
+            }
+            numbers[incr] = value;
+            incr++;
+        }
+    }
+    if (incr != total_random_num) {
+        printf("Rand file %s has %d random numbers but its header says %d\n", rand_file.path.c_str(), incr, total_random_num);
+        return false;
     }
+    return true;
 
 }
 
-int ofs = 0;
+// Each simulation reads the random numbers from the beginning with its own offset
+struct RandomStream {
+    int ofs = 0;
 
-int get_random_number(int burst) { 
+    int get_random_number(int burst) { 
 
-    int randomVal = 1 + (random_nums[ofs] % burst);
-    ofs++;
-    if (ofs == total_random_num) {
-        ofs = 0;
-    }
-    return randomVal;
+        int randomVal = 1 + (random_nums[ofs] % burst);
+        ofs++;
+        if (ofs == total_random_num) {
+            ofs = 0;
+        }
+        return randomVal;
 
-}
+    }
+};
 
 
 //-------------------- STEP 4 : Create the Event class --------------------
@@ -424,428 +948,2853 @@ enum State {CREATED, READY, RUNNING, BLOCKED, DONE}; // enum of states
 struct Event {
 
     int timestamp;
-    Process* process;
+    Process* process; // nullptr for the boost events of MLFQ
     State old_state;
     State new_state;
 
+    // DES attributes
+    long long seq; // Insertion order in the DES layer. Used to break ties between events with the same timestamp
+    bool cancelled; // Tombstone set by remove_event. A cancelled event is dropped when it reaches the front of the DES layer
+    Event* next_in_slot; // Next event in the same slot of the timing wheel
+
     Event(int timestamp_, Process* process_, State old_state_, State new_state_) {
         timestamp = timestamp_;
         process = process_;
         old_state = old_state_;
         new_state = new_state_;
+        seq = 0;
+        cancelled = false;
+        next_in_slot = nullptr;
+    }
+
+    // Events are allocated in the event pool (see STEP 0) and deleted by the DES layer once processed
+    static void* operator new(size_t size) {
+        return Pool<Event, 4096>::allocate();
+    }
+
+    static void operator delete(void* ptr) {
+        Pool<Event, 4096>::release(ptr);
     }
 
 };
 
 //-------------------- STEP 5 : Create the DES layer --------------------
-// We implement the DES as a linked list but the most optimal would be a prioqueue with the timestamp as the priority
-// But I'm not sure the assignement allows us to use a prio queue for the DES
+// The DES layer gives the events in order of (timestamp, seq)
+// seq is the insertion order of the event so events with the same timestamp are processed in order of appearance,
+// exactly like a sorted linked list where a new event goes after every event with a smaller or equal timestamp.
+// A process has at most one event in the DES layer at any time, so the process keeps a handle on it (pending_event).
+// Cancelling that event is O(1): we only mark it as cancelled and it is lazily discarded when it reaches the front of the queue
+// The storage of the events is delegated to an EventQueue engine chosen with the -q option (list, heap or timing wheel)
+// The DES layer owns the events : an event returned by get_event is deleted at the next call of get_event
+// Each simulation has its own DES layer
+// The CREATED->READY events are not stored in the queue : they are streamed from the input file (see STEP 6).
+// The DES layer only holds the next arrival and merges it with the queue. An arrival goes before the queued events with the same timestamp,
+// as if every arrival had been put in the DES layer before the simulation started.
+// Apart from that, an arrival is put like the other events : the simulator puts the next arrival (put_arrival) when the previous one
+// is taken, it gets a seq and it goes through the -e trace and the -S counters (see Simulator::put_arrival)
+
+// True if event a must be processed before event b
+bool is_before(Event* a, Event* b) {
+    if (a->timestamp != b->timestamp) {
+        return a->timestamp < b->timestamp;
+    }
+    return a->seq < b->seq;
+}
 
-list<Event*> events;
-struct DES_Layer {
+// EventQueue Base class
+class EventQueue {
 
-    static void put_event(Event* new_event_ptr) {
-        std::list<Event*>::iterator it = events.begin();
-        while(it != events.end()) {
-            Event* curr_event_ptr = *it;
-            if (curr_event_ptr->timestamp <= new_event_ptr->timestamp) {
+    public:
+        // pure virtual function providing interface framework.
+        virtual void push(Event* event) = 0;
+        virtual Event* front() = 0; // Next event in (timestamp, seq) order. nullptr if the queue is empty
+        virtual void pop() = 0; // Remove the front event
+        virtual size_t size() = 0; // Number of events, cancelled ones included
+        virtual ~EventQueue() {}
+
+};
+
+// Sorted linked list. O(n) insertion
+class ListEventQueue: public EventQueue {
+    public:
+        list<Event*> events;
+
+        void push(Event* new_event_ptr) {
+            // Events are pushed in seq order so going after every event with a smaller or equal timestamp keeps the (timestamp, seq) order
+            std::list<Event*>::reverse_iterator it = events.rbegin();
+            while (it != events.rend() && (*it)->timestamp > new_event_ptr->timestamp) {
                 it++;
-            } else {
-                events.insert(it, new_event_ptr);
-                return;
             }
+            events.insert(it.base(), new_event_ptr);
         }
 
-        // If we are here, it means we didn't insert the event so it must have the largest timestamp of the list of events
-        // ==> We add it at the back
-        events.push_back(new_event_ptr);
-    }
-
-    static Event* get_event() {
-        Event* event = events.front();
-        if (event == 0) {
-            return 0;
+        Event* front() {
+            if (events.empty()) {
+                return nullptr;
+            }
+            return events.front();
         }
-        events.pop_front();
-        return event;
-    }
 
-    static void remove_event(Process* preempted_process) {
-        // Need to remove the RUNNING->BLOCKED or RUNNING->READY event from preempted_process
-        // Used by E scheduler only
-        // Loop is valid because we are 100% sure that the event exist 
-        // (it must have been created during the RUNNING event of this process)
-        // This event is the unique one that concerns the preempted_process so we use the PID as filter
-        std::list<Event*>::iterator it = events.begin();
-        while( ((*it)->process)->pid != preempted_process->pid ) {
-            it++;
+        void pop() {
+            events.pop_front();
         }
-        // Now it points to the event we want to delete
-        events.erase(it);
-
-        
-    }
 
-    static int get_next_time_event(){
-        if (events.empty()) {
-            return -1; // No events remaining (!!! =/= end of simulation, we have to check if the ready processes queue is empty !!!)
-        }
-        else {
-            int next_time = events.front()->timestamp;
-            return next_time;
+        size_t size() {
+            return events.size();
         }
-    }
-
 
 };
 
+// Binary min-heap. O(log n) insertion and removal
+class HeapEventQueue: public EventQueue {
+    public:
+        vector<Event*> events; // events[0] is the next event
 
-//-------------------- STEP 6 : Create processes queue in order of their appearance in the input file + create first events --------------------
-// We assume the input files are not tricky so we do not check if the arrival time are properly increasing
-
-queue<Process*> processes; // Processes queue (in order of the file)
-void createProcesses(istream& input_file, Scheduler* scheduler) {
-    double at, totCPU, cpuB, ioB;
-    int static_prio;
+        void push(Event* new_event_ptr) {
+            events.push_back(new_event_ptr);
+            sift_up(events.size() - 1);
+        }
 
-    int count= 0; // Same as pid. We use the order of arrival as the pid of the process
-    while (input_file >> at >> totCPU >> cpuB >> ioB) {
-        Process* process = new Process(count, at, totCPU, cpuB, ioB);
-        process->static_prio = get_random_number(scheduler->maxprio);
-        process->dynamic_prio = process->static_prio - 1;
-        processes.push(process);
-        events.push_back(new Event(at, process, CREATED, READY));
-        count++;
-    }
-};
+        Event* front() {
+            if (events.empty()) {
+                return nullptr;
+            }
+            return events.front();
+        }
 
+        void pop() {
+            // Move the last event at the top and restore the heap property from there
+            Event* last = events.back();
+            events.pop_back();
+            if (!events.empty()) {
+                events[0] = last;
+                sift_down(0);
+            }
+        }
 
-//-------------------- STEP 8 : Make Simulation --------------------
+        size_t size() {
+            return events.size();
+        }
 
+    private:
+        void sift_up(int index) {
+            Event* event = events[index];
+            while (index > 0) {
+                int parent = (index - 1) / 2;
+                if (!is_before(event, events[parent])) {
+                    break;
+                }
+                events[index] = events[parent];
+                index = parent;
+            }
+            events[index] = event;
+        }
+
+        void sift_down(int index) {
+            int size = events.size();
+            Event* event = events[index];
+            while (true) {
+                int child = 2 * index + 1;
+                if (child >= size) {
+                    break;
+                }
+                // Take the earliest of the two children
+                if (child + 1 < size && is_before(events[child + 1], events[child])) {
+                    child++;
+                }
+                if (!is_before(events[child], event)) {
+                    break;
+                }
+                events[index] = events[child];
+                index = child;
+            }
+            events[index] = event;
+        }
+
+};
+
+// Timing wheel. Amortized O(1) insertion and removal
+// The wheel has one FIFO slot per time unit for the window [now, now + WHEEL_SIZE)
+// Since the window is smaller than the wheel, a slot only holds events of one timestamp, already in seq order.
+// cpu bursts, io bursts and quantums are bounded so most events land in the window.
+// The other ones (long io bursts, long quantums and the MLFQ boost events) wait in an overflow heap
+// and move to the wheel once the window reaches them. The future arrivals never come here : the DES layer streams them (see STEP 6).
+// An overflow event always has a smaller seq than a wheel event with the same timestamp 
+// (it was pushed when the window was earlier) so moving it at the back of its slot keeps the order
+const int WHEEL_SIZE = 4096; // Must be a power of 2
+class WheelEventQueue: public EventQueue {
+    public:
+        vector<Event*> heads; // First event of each slot
+        vector<Event*> tails; // Last event of each slot
+        int wheel_count = 0; // Number of events in the wheel (overflow excluded)
+        int now = 0; // Timestamp of the last processed event. Every event in the queue has a timestamp >= now
+        int scan_time = 0; // No event of the wheel has a timestamp in [now, scan_time)
+        HeapEventQueue overflow; // Events with timestamp >= now + WHEEL_SIZE
+
+        void push(Event* new_event_ptr) {
+            if (new_event_ptr->timestamp - now >= WHEEL_SIZE) {
+                overflow.push(new_event_ptr);
+            } else {
+                push_wheel(new_event_ptr);
+            }
+        }
+
+        Event* front() {
+            if (wheel_count == 0) {
+                return overflow.front();
+            }
+            // The wheel is not empty so the scan stops within WHEEL_SIZE slots
+            while (heads[scan_time & (WHEEL_SIZE - 1)] == nullptr) {
+                scan_time++;
+            }
+            return heads[scan_time & (WHEEL_SIZE - 1)];
+        }
+
+        void pop() {
+            Event* event = front();
+            if (wheel_count == 0) {
+                overflow.pop();
+            } else {
+                int slot = event->timestamp & (WHEEL_SIZE - 1);
+                heads[slot] = event->next_in_slot;
+                if (heads[slot] == nullptr) {
+                    tails[slot] = nullptr;
+                }
+                wheel_count--;
+            }
+            event->next_in_slot = nullptr;
+
+            // A cancelled event is in the future of the simulation, so it must not move the window
+            if (event->cancelled) {
+                return;
+            }
+
+            // Move the window forward and bring in the overflow events that now fit in it
+            now = event->timestamp;
+            scan_time = now;
+            while (overflow.front() != nullptr && overflow.front()->timestamp - now < WHEEL_SIZE) {
+                Event* next_event = overflow.front();
+                overflow.pop();
+                push_wheel(next_event);
+            }
+        }
+
+        size_t size() {
+            return wheel_count + overflow.size();
+        }
+
+        WheelEventQueue():EventQueue() {
+            heads.assign(WHEEL_SIZE, nullptr);
+            tails.assign(WHEEL_SIZE, nullptr);
+        }
+
+    private:
+        void push_wheel(Event* new_event_ptr) {
+            int slot = new_event_ptr->timestamp & (WHEEL_SIZE - 1);
+            new_event_ptr->next_in_slot = nullptr;
+            if (tails[slot] == nullptr) {
+                heads[slot] = new_event_ptr;
+            } else {
+                tails[slot]->next_in_slot = new_event_ptr;
+            }
+            tails[slot] = new_event_ptr;
+            wheel_count++;
+            if (new_event_ptr->timestamp < scan_time) {
+                scan_time = new_event_ptr->timestamp;
+            }
+        }
+
+};
+
+// Source of the CREATED->READY events in order of arrival
+class ArrivalSource {
+
+    public:
+        // pure virtual function providing interface framework.
+        virtual Event* next_arrival() = 0; // nullptr when there are no more arrivals
+        virtual ~ArrivalSource() {}
+
+};
+
+struct DES_Layer {
+    EventQueue* events; // Chosen in main
+    long long event_seq = 0; // Next insertion sequence number
+    Event* last_event = nullptr; // Last event returned by get_event, deleted at the next call
+    Event* next_arrival = nullptr; // Next CREATED->READY event of the stream (nullptr if none)
+
+    DES_Layer(EventQueue* events_) {
+        events = events_;
+    }
+
+    ~DES_Layer() {
+        delete last_event;
+        delete events;
+    }
+
+    // The next arrival of the stream (nullptr if there are no more arrivals). The previous one must have been taken by get_event
+    void put_arrival(Event* arrival) {
+        if (arrival != nullptr) {
+            arrival->seq = event_seq++;
+            arrival->process->pending_event = arrival;
+        }
+        next_arrival = arrival;
+    }
+
+    void put_event(Event* new_event_ptr) {
+        new_event_ptr->seq = event_seq++;
+        // The boost events of MLFQ have no process
+        if (new_event_ptr->process != nullptr) {
+            new_event_ptr->process->pending_event = new_event_ptr;
+        }
+        events->push(new_event_ptr);
+    }
+
+    void drop_cancelled() {
+        // Discard the tombstones sitting at the front of the queue
+        while (events->front() != nullptr && events->front()->cancelled) {
+            Event* event = events->front();
+            events->pop();
+            delete event;
+        }
+    }
+
+    Event* get_event() {
+        // The simulation is done with the previous event so we recycle it
+        delete last_event;
+        last_event = nullptr;
+
+        drop_cancelled();
+        Event* event = events->front();
+        // The next arrival goes first if it is not later than the front of the queue
+        if (next_arrival != nullptr && (event == nullptr || next_arrival->timestamp <= event->timestamp)) {
+            event = next_arrival;
+            next_arrival = nullptr;
+        }
+        else if (event == 0) {
+            return 0;
+        }
+        else {
+            events->pop();
+        }
+        if (event->process != nullptr) {
+            event->process->pending_event = nullptr;
+        }
+        last_event = event;
+        return event;
+    }
+
+    void remove_event(Process* preempted_process) {
+        // Need to remove the RUNNING->BLOCKED or RUNNING->READY event from preempted_process
+        // Used by E scheduler only
+        // The handle is valid because we are 100% sure that the event exist 
+        // (it must have been created during the RUNNING event of this process)
+        Event* event = preempted_process->pending_event;
+        event->cancelled = true;
+        preempted_process->pending_event = nullptr;
+    }
+
+    int get_next_time_event(){
+        drop_cancelled();
+        Event* event = events->front();
+        if (next_arrival != nullptr && (event == nullptr || next_arrival->timestamp < event->timestamp)) {
+            event = next_arrival;
+        }
+        if (event == nullptr) {
+            return -1; // No events remaining (!!! =/= end of simulation, we have to check if the ready processes queue is empty !!!)
+        }
+        else {
+            int next_time = event->timestamp;
+            return next_time;
+        }
+    }
+
+
+};
+
+
+//-------------------- STEP 6 : Stream the processes in order of their appearance in the input file --------------------
+// The processes are not all created before the simulation : the reader creates the next process (and its CREATED->READY event)
+// only when the DES layer consumes the previous arrival, so the DES layer holds at most one future arrival.
+// The input file is checked once before the simulation so a malformed line is reported before anything runs.
+
+// Same checks on the records of a binary input file
+bool check_binary_input_file(const MappedFile& input_file, int& number_processes) {
+    int64_t number_records;
+    const int32_t* records = binary_records(input_file, 4, number_records);
+    if (records == nullptr) {
+        return false;
+    }
+    if (number_records > INT_MAX) {
+        printf("Binary input file %s has more than %d processes\n", input_file.path.c_str(), INT_MAX);
+        return false;
+    }
+    int last_arrival = 0;
+    for (int64_t i = 0; i < number_records; i++) {
+        const int32_t* record = records + 4 * i;
+        if (record[0] < 0 || record[1] < 0 || record[2] < 0 || record[3] < 0) {
+            printf("Malformed record %lld in input file %s : negative value\n", (long long) i + 1, input_file.path.c_str());
+            return false;
+        }
+        if (record[0] < last_arrival) {
+            printf("Malformed record %lld in input file %s : arrival time is before the previous one\n", (long long) i + 1, input_file.path.c_str());
+            return false;
+        }
+        last_arrival = record[0];
+    }
+    number_processes = number_records;
+    return true;
+}
+
+// Each line is "AT TC CB IO" and the arrival times must not decrease. Blank lines are skipped
+// Returns false (after printing the line number) if a line doesn't follow this format. Otherwise number_processes is the number of processes of the file
+bool check_input_file(const MappedFile& input_file, int& number_processes) {
+    if (is_binary_file(input_file, WORKLOAD_MAGIC)) {
+        return check_binary_input_file(input_file, number_processes);
+    }
+
+    LineTokenizer tokenizer(input_file);
+    int values[4]; // at, totCPU, cpuB, ioB
+    int count_values;
+    int last_arrival = 0;
+
+    number_processes = 0;
+    while ((count_values = tokenizer.next_line(values, 4)) != -1) {
+        if (count_values == 0) {
+            continue;
+        }
+        if (count_values != 4) {
+            printf("Malformed line %d in input file %s : expected AT TC CB IO\n", tokenizer.line_number, input_file.path.c_str());
+            return false;
+        }
+        if (values[0] < last_arrival) {
+            printf("Malformed line %d in input file %s : arrival time is before the previous one\n", tokenizer.line_number, input_file.path.c_str());
+            return false;
+        }
+        last_arrival = values[0];
+        number_processes++;
+    }
+    return true;
+}
+
+// Creates the processes of a checked input file one by one
+// The static priorities use their own random stream from the beginning of the random numbers, 
+// as when all the processes were created before the simulation
+class ProcessReader final: public ArrivalSource {
+    public:
+        // Parallel mode (see STEP 13) : the reader only creates the processes of its partition (pid % number_partitions == partition)
+        int partition = 0;
+        int number_partitions = 1;
+
+        Event* next_arrival() {
+            int values[4]; // at, totCPU, cpuB, ioB
+            while (true) {
+                if (records != nullptr) {
+                    // Binary file : the next record
+                    if (count == number_records) {
+                        return nullptr;
+                    }
+                    memcpy(values, records + 4 * count, sizeof(values));
+                }
+                else {
+                    // Text file : the next line (blank lines are skipped)
+                    int count_values;
+                    while ((count_values = tokenizer.next_line(values, 4)) == 0) {}
+                    if (count_values != 4) {
+                        return nullptr; // End of the file (the file was checked before)
+                    }
+                }
+                // The processes of the other partitions draw their static priority too so every process gets the same one
+                int static_prio = random.get_random_number(scheduler->maxprio);
+                if (count % number_partitions != partition) {
+                    count++;
+                    continue;
+                }
+                Process* process = new Process(count, values[0], values[1], values[2], values[3]);
+                process->static_prio = static_prio;
+                process->dynamic_prio = process->static_prio - 1;
+                processes.push(process);
+                count++;
+                return new Event(values[0], process, CREATED, READY);
+            }
+        }
+
+        // processes is the processes queue (in order of the file)
+        ProcessReader(const MappedFile& input_file, Scheduler* scheduler_, queue<Process*>& processes_):tokenizer(input_file), processes(processes_) {
+            scheduler = scheduler_;
+            if (is_binary_file(input_file, WORKLOAD_MAGIC)) {
+                records = binary_records(input_file, 4, number_records);
+            }
+        }
+
+    private:
+        LineTokenizer tokenizer; // Text file
+        const int32_t* records = nullptr; // Binary file (nullptr for a text file)
+        int64_t number_records = 0;
+        Scheduler* scheduler;
+        RandomStream random;
+        queue<Process*>& processes;
+        int count = 0; // Same as pid. We use the order of arrival as the pid of the process
+};
+
+
+//-------------------- STEP 7 : Buffered output --------------------
+// The summary lines are formatted in a big buffer which goes to the output file in one fwrite when it is full
+
+const int OUTPUT_BUFFER_SIZE = 1 << 20;
+class OutputBuffer {
+    public:
+        // Same as fprintf. A formatted line must be shorter than OUTPUT_LINE_MAX
+        void printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+            if (OUTPUT_BUFFER_SIZE - used < OUTPUT_LINE_MAX) {
+                flush();
+            }
+            va_list args;
+            va_start(args, format);
+            used += vsnprintf(&buffer[used], OUTPUT_BUFFER_SIZE - used, format, args);
+            va_end(args);
+        }
+
+        void flush() {
+            fwrite(&buffer[0], 1, used, out);
+            used = 0;
+        }
+
+        OutputBuffer(FILE* out_):buffer(OUTPUT_BUFFER_SIZE) {
+            out = out_;
+        }
+
+        ~OutputBuffer() {
+            flush();
+        }
+
+    private:
+        static const int OUTPUT_LINE_MAX = 256;
+        FILE* out;
+        vector<char> buffer;
+        int used = 0; // number of characters in the buffer
+};
+
+// Trace of the -v, -t, -e and -p options
+// The simulation loop only appends fixed size binary records to a preallocated buffer. The records are formatted
+// (in the format of the reference scheduler) when the buffer is full and at the end of the run, so tracing a big run costs
+// one record copy per traced action instead of one formatted cout line
+enum TraceKind {
+    TRACE_TRANSITION, // -v : state transition of a process
+    TRACE_ADD_EVENT, // -e : event put in the DES layer
+    TRACE_REMOVE_EVENT, // -e : event cancelled by an E preemption
+    TRACE_SCHED, // -t : the scheduler picks the next running process
+    TRACE_PREEMPT, // -p : E preemption test
+    TRACE_BOOST // -t : MLFQ boost
+};
+
+struct TraceRecord {
+    unsigned char kind; // TraceKind
+    unsigned char old_state;
+    unsigned char new_state;
+    bool decision; // TRACE_PREEMPT only
+    int time;
+    int pid;
+    int values[4]; // Meaning depends on the kind (see format_record)
+};
+
+const int TRACE_CAPACITY = 1 << 16; // Number of records formatted at once
+const char* trace_state_names[] = {"CREATED", "READY", "RUNNG", "BLOCK", "Done"};
+
+class TraceBuffer {
+    public:
+        bool verbose; // -v
+        bool trace_sched; // -t
+        bool trace_events; // -e
+        bool trace_preempt; // -p
+
+        // time_in_state is the time spent in old_state. cb, rem and prio depend on the transition (see format_record)
+        void transition(int time, int pid, int time_in_state, State old_state, State new_state, int burst = 0, int rem = 0, int prio = 0) {
+            TraceRecord& record = append(TRACE_TRANSITION, time, pid);
+            record.old_state = old_state;
+            record.new_state = new_state;
+            record.values[0] = time_in_state;
+            record.values[1] = burst;
+            record.values[2] = rem;
+            record.values[3] = prio;
+        }
+
+        void add_event(int time, int pid, State old_state, State new_state, int depth) {
+            TraceRecord& record = append(TRACE_ADD_EVENT, time, pid);
+            record.old_state = old_state;
+            record.new_state = new_state;
+            record.values[0] = depth;
+        }
+
+        void remove_event(int time, int pid) {
+            append(TRACE_REMOVE_EVENT, time, pid);
+        }
+
+        // pid is the chosen process (-1 if none), ready_processes the size of the ready queue before the choice
+        void sched(int time, int pid, int ready_processes) {
+            TraceRecord& record = append(TRACE_SCHED, time, pid);
+            record.values[0] = ready_processes;
+        }
+
+        void boost(int time, int ready_processes) {
+            TraceRecord& record = append(TRACE_BOOST, time, -1);
+            record.values[0] = ready_processes;
+        }
+
+        void preempt(int time, int running_pid, int pid, bool prio_test, int stop_running_time, bool decision) {
+            TraceRecord& record = append(TRACE_PREEMPT, time, pid);
+            record.values[0] = running_pid;
+            record.values[1] = prio_test;
+            record.values[2] = stop_running_time;
+            record.decision = decision;
+        }
+
+        // Format every record and write them
+        void flush() {
+            for (size_t i = 0; i < count; i++) {
+                format_record(records[i]);
+            }
+            count = 0;
+            output.flush();
+        }
+
+        TraceBuffer(FILE* out, bool verbose_, bool trace_sched_, bool trace_events_, bool trace_preempt_)
+            :records(TRACE_CAPACITY), output(out) {
+            verbose = verbose_;
+            trace_sched = trace_sched_;
+            trace_events = trace_events_;
+            trace_preempt = trace_preempt_;
+        }
+
+        ~TraceBuffer() {
+            flush();
+        }
+
+    private:
+        vector<TraceRecord> records;
+        size_t count = 0; // Number of records not formatted yet
+        OutputBuffer output;
+
+        TraceRecord& append(TraceKind kind, int time, int pid) {
+            if (count == records.size()) {
+                flush();
+            }
+            TraceRecord& record = records[count++];
+            record.kind = kind;
+            record.time = time;
+            record.pid = pid;
+            return record;
+        }
+
+        void format_record(const TraceRecord& record) {
+            switch (record.kind) {
+                case TRACE_TRANSITION : {
+                    if (record.new_state == DONE) {
+                        output.printf("%d %d %d: Done\n", record.time, record.pid, record.values[0]);
+                    } 
+                    else if (record.old_state == READY && record.new_state == RUNNING) {
+                        output.printf("%d %d %d: READY -> RUNNG cb=%d rem=%d prio=%d\n", 
+                                record.time, record.pid, record.values[0], record.values[1], record.values[2], record.values[3]);
+                    }
+                    else if (record.old_state == RUNNING && record.new_state == BLOCKED) {
+                        output.printf("%d %d %d: RUNNG -> BLOCK  ib=%d rem=%d\n", 
+                                record.time, record.pid, record.values[0], record.values[1], record.values[2]);
+                    }
+                    else if (record.old_state == RUNNING && record.new_state == READY) {
+                        output.printf("%d %d %d: RUNNG -> READY  cb=%d rem=%d prio=%d\n", 
+                                record.time, record.pid, record.values[0], record.values[1], record.values[2], record.values[3]);
+                    }
+                    else {
+                        output.printf("%d %d %d: %s -> %s\n", record.time, record.pid, record.values[0], 
+                                trace_state_names[record.old_state], trace_state_names[record.new_state]);
+                    }
+                    break;
+                }
+                case TRACE_ADD_EVENT : {
+                    // The boost events of MLFQ have no process
+                    if (record.pid < 0) {
+                        output.printf("  AddEvent(%d:BOOST) depth=%d\n", record.time, record.values[0]);
+                        break;
+                    }
+                    output.printf("  AddEvent(%d:%d:%s -> %s) depth=%d\n", record.time, record.pid, 
+                            trace_state_names[record.old_state], trace_state_names[record.new_state], record.values[0]);
+                    break;
+                }
+                case TRACE_REMOVE_EVENT : {
+                    output.printf("  RemoveEvent(%d)\n", record.pid);
+                    break;
+                }
+                case TRACE_BOOST : {
+                    output.printf("BOOST (%d)\n", record.values[0]);
+                    break;
+                }
+                case TRACE_SCHED : {
+                    if (record.pid < 0) {
+                        output.printf("SCHED (%d): no process\n", record.values[0]);
+                    } else {
+                        output.printf("SCHED (%d): --> %d\n", record.values[0], record.pid);
+                    }
+                    break;
+                }
+                case TRACE_PREEMPT : {
+                    output.printf("    --> PRIO preemption %d by %d ? %d TS=%d now=%d) --> %s\n", record.values[0], record.pid, 
+                            record.values[1], record.values[2], record.time, record.decision ? "YES" : "NO");
+                    break;
+                }
+            }
+        }
+};
+
+
+//-------------------- STEP 8 : Make Simulation --------------------
+// The simulation loop is a template over a stats policy too (see run_simulation).
+// NoStats does nothing, so without -S the calls are empty inline functions and the counters cost nothing.
+// SimulationStats counts what happens in the loop to explain a slow or pathological workload :
+// how many events of each transition, how deep the DES layer is at each insertion, how many preemptions cancel an event,
+// how big the ready queue gets and how many random numbers are drawn
+
+const char* state_names[] = {"CREATED", "READY", "RUNNING", "BLOCKED", "DONE"};
+
+struct NoStats {
+    void transition(State old_state, State new_state) {}
+    void event_queued(DES_Layer& des) {}
+    void event_removed() {}
+    template <typename SchedulerType>
+    void process_ready(SchedulerType* scheduler) {}
+    template <typename SchedulerType>
+    void next_process(SchedulerType* scheduler) {}
+    void random_number() {}
+    void process_stolen() {}
+};
+
+struct SimulationStats {
+    long long transitions[5][5] = {}; // Number of events by [old state][new state]
+    long long number_put_events = 0;
+    long long total_queue_depth = 0; // Sum of the DES layer sizes after each put_event
+    size_t max_queue_depth = 0;
+    long long number_removed_events = 0; // E preemptions
+    size_t max_ready_processes = 0; // High-water mark of the ready queue
+    long long number_random_numbers = 0;
+    long long number_swaps = 0; // Swaps of the active and expired queues (PRIO and PREPRIO only)
+    long long number_boosts = 0; // MLFQ boosts (the cores boost together). Copied from the first core at the end of the run
+    long long number_steals = 0; // Processes taken from the run queue of another core (-c)
+
+    void transition(State old_state, State new_state) {
+        transitions[old_state][new_state]++;
+    }
+
+    // The depth includes the cancelled events not dropped yet, but not the next arrival
+    void event_queued(DES_Layer& des) {
+        size_t depth = des.events->size();
+        number_put_events++;
+        total_queue_depth += depth;
+        if (depth > max_queue_depth) {
+            max_queue_depth = depth;
+        }
+    }
+
+    void event_removed() {
+        number_removed_events++;
+    }
+
+    template <typename SchedulerType>
+    void process_ready(SchedulerType* scheduler) {
+        size_t ready_processes = scheduler->size();
+        if (ready_processes > max_ready_processes) {
+            max_ready_processes = ready_processes;
+        }
+    }
+
+    // Called before each get_next_process of the loops. Only PRIO and PREPRIO have something to count
+    template <typename SchedulerType>
+    void next_process(SchedulerType* scheduler) {}
+
+    // get_next_process swaps the active and expired queues when the active one is empty
+    template <typename PreemptionPolicy>
+    void next_process(MultiLevelScheduler<PreemptionPolicy>* scheduler) {
+        if (scheduler->activeQ->empty()) {
+            number_swaps++;
+        }
+    }
+
+    void random_number() {
+        number_random_numbers++;
+    }
+
+    void process_stolen() {
+        number_steals++;
+    }
+
+    void print(FILE* out) {
+        long long number_events = 0;
+        fprintf(out, "STATS\n");
+        for (int old_state = 0; old_state < 5; old_state++) {
+            for (int new_state = 0; new_state < 5; new_state++) {
+                if (transitions[old_state][new_state] > 0) {
+                    fprintf(out, "%-18s %12lld\n", 
+                            (string(state_names[old_state]) + "->" + state_names[new_state]).c_str(), 
+                            transitions[old_state][new_state]);
+                    number_events += transitions[old_state][new_state];
+                }
+            }
+        }
+        fprintf(out, "%-18s %12lld\n", "events", number_events);
+        fprintf(out, "%-18s %12lld (avg depth %.2f, max depth %zu)\n", "put_event", number_put_events,
+                number_put_events > 0 ? (double) total_queue_depth / number_put_events : 0.0, max_queue_depth);
+        fprintf(out, "%-18s %12lld\n", "remove_event", number_removed_events);
+        fprintf(out, "%-18s %12lld\n", "queue swaps", number_swaps);
+        fprintf(out, "%-18s %12lld\n", "boosts", number_boosts);
+        fprintf(out, "%-18s %12zu\n", "max ready", max_ready_processes);
+        fprintf(out, "%-18s %12lld\n", "random numbers", number_random_numbers);
+        fprintf(out, "%-18s %12lld\n", "steals", number_steals);
+    }
+};
+
+// Latency percentiles of the -L option
+// LatencyHistogram is a log-linear histogram of non-negative ints (like HdrHistogram) : the values below 2^SUB_BUCKET_BITS
+// have one bucket each, and above that every power of 2 is split into 2^(SUB_BUCKET_BITS - 1) buckets.
+// A value is recorded in O(1) with a relative error below 2^-(SUB_BUCKET_BITS - 1) and the memory is fixed whatever the size of the run
+const int SUB_BUCKET_BITS = 8;
+const int SUB_BUCKET_HALF = 1 << (SUB_BUCKET_BITS - 1);
+const int HISTOGRAM_BUCKETS = (31 - SUB_BUCKET_BITS + 2) * SUB_BUCKET_HALF; // Enough for any int
+
+class LatencyHistogram {
+    public:
+        void record(int value) {
+            if (value < 0) {
+                value = 0;
+            }
+            counts[bucket(value)]++;
+            count++;
+            if (value > max_value) {
+                max_value = value;
+            }
+        }
+
+        // Smallest value such that percent % of the recorded values are lower or equal (up to the precision of the buckets)
+        int percentile(double percent) {
+            if (count == 0) {
+                return 0;
+            }
+            long long rank = (long long) ceil(percent / 100 * count);
+            if (rank < 1) {
+                rank = 1;
+            }
+            long long seen = 0;
+            for (int index = 0; index < HISTOGRAM_BUCKETS; index++) {
+                seen += counts[index];
+                if (seen >= rank) {
+                    return min(highest_value(index), max_value);
+                }
+            }
+            return max_value;
+        }
+
+        long long count = 0;
+        int max_value = 0;
+
+        LatencyHistogram():counts(HISTOGRAM_BUCKETS, 0) {}
+
+    private:
+        vector<long long> counts;
+
+        static int bucket(int value) {
+            if (value < 2 * SUB_BUCKET_HALF) {
+                return value;
+            }
+            // The SUB_BUCKET_BITS highest bits of the value give its bucket
+            int shift = (31 - __builtin_clz(value)) - (SUB_BUCKET_BITS - 1);
+            return shift * SUB_BUCKET_HALF + (value >> shift);
+        }
+
+        // Highest value recorded in the bucket
+        static int highest_value(int index) {
+            if (index < 2 * SUB_BUCKET_HALF) {
+                return index;
+            }
+            int shift = index / SUB_BUCKET_HALF - 1;
+            long long sub_bucket = index - shift * SUB_BUCKET_HALF;
+            return (int) min(((sub_bucket + 1) << shift) - 1, (long long) INT_MAX);
+        }
+};
+
+struct LatencyReport {
+    LatencyHistogram turnaround; // One value per process
+    LatencyHistogram cpu_wait; // Total time in READY state, one value per process
+    LatencyHistogram io_wait; // Total time in BLOCKED state, one value per process
+    LatencyHistogram ready_wait; // Time in READY state before each dispatch
+    LatencyHistogram io_queue_wait; // Time waiting for a device before each IO (-i only)
+
+    void print_histogram(OutputBuffer& out, const char* name, LatencyHistogram& histogram) {
+        out.printf("%-10s %10lld %8d %8d %8d %8d %8d\n", name, histogram.count,
+                histogram.percentile(50), histogram.percentile(90), histogram.percentile(99), histogram.percentile(99.9),
+                histogram.max_value);
+    }
+
+    void print(OutputBuffer& out) {
+        out.printf("LAT:            count      p50      p90      p99    p99.9      max\n");
+        print_histogram(out, "turnaround", turnaround);
+        print_histogram(out, "cpu wait", cpu_wait);
+        print_histogram(out, "io wait", io_wait);
+        print_histogram(out, "ready wait", ready_wait);
+        if (io_queue_wait.count > 0) {
+            print_histogram(out, "io queue", io_queue_wait);
+        }
+    }
+};
+
+
+// Time windows of the parallel mode (see STEP 13)
+class PartitionWindow;
+
+// IO busy interval [start, end) of a partition of the parallel mode
+struct IOInterval {
+    int start;
+    int end;
+};
+
+// Set of cores as a bitmap. Finding a core of the set is one count-trailing-zeros per 64 cores
+class CoreSet {
+    public:
+        void insert(int core) {
+            words[core / 64] |= 1ULL << (core % 64);
+        }
+
+        void erase(int core) {
+            words[core / 64] &= ~(1ULL << (core % 64));
+        }
+
+        bool contains(int core) {
+            return (words[core / 64] >> (core % 64)) & 1;
+        }
+
+        // Lowest core of the set. -1 if the set is empty
+        int first() {
+            for (size_t word = 0; word < words.size(); word++) {
+                if (words[word] != 0) {
+                    return word * 64 + __builtin_ctzll(words[word]);
+                }
+            }
+            return -1;
+        }
+
+        // First core of the set after core, going round from the last core to core 0. -1 if the set is empty
+        int next(int core) {
+            int number_words = words.size();
+            int word = core / 64;
+            // The cores of the same word after core
+            unsigned long long after = (core % 64 == 63) ? 0 : words[word] & (~0ULL << (core % 64 + 1));
+            if (after != 0) {
+                return word * 64 + __builtin_ctzll(after);
+            }
+            // The next words, then the cores of the word of core up to core
+            for (int i = 1; i <= number_words; i++) {
+                int next_word = (word + i) % number_words;
+                if (words[next_word] != 0) {
+                    return next_word * 64 + __builtin_ctzll(words[next_word]);
+                }
+            }
+            return -1;
+        }
+
+        CoreSet(int number_cores):words((number_cores + 63) / 64, 0) {}
+
+    private:
+        vector<unsigned long long> words;
+};
+
+// IO devices of the -i option
+// Without -i every BLOCKED process does its IO at once, on its own, so IO never contends.
+// With -i, the IO of process pid goes to the device pid % K. A device serves one request at a time and the other requests
+// wait in its queue. Each request reads a track of the device (drawn from the random numbers) : the service time is the io burst
+// plus the seek time from the current track of the head. The queue policy chooses the next request :
+// FIFO (F), shortest seek time first (S) or deadline (D<deadline>) which is SSTF unless the oldest request waited more than deadline
+const int NUMBER_TRACKS = 1000;
+const int TRACKS_PER_TIME_UNIT = 100; // Seek speed of the head
+
+struct IORequest {
+    Process* process;
+    int track;
+    int io_burst; // Transfer time
+    int enqueue_time;
+};
+
+// IOQueue Base class
+class IOQueue {
+
+    public:
+        // pure virtual function providing interface framework.
+        virtual void push(const IORequest& request) = 0;
+        virtual bool empty() = 0;
+        virtual IORequest pop(int head, int now) = 0; // Next request to serve for a head on track head. The queue is not empty
+        virtual ~IOQueue() {}
+
+};
+
+class FIFOIOQueue final: public IOQueue {
+    public:
+        deque<IORequest> requests;
+
+        void push(const IORequest& request) {
+            requests.push_back(request);
+        }
+
+        bool empty() {
+            return requests.empty();
+        }
+
+        IORequest pop(int head, int now) {
+            IORequest request = requests.front();
+            requests.pop_front();
+            return request;
+        }
+};
+
+// Entry of a multimap ordered by track with the track closest to head (the lower track on a tie)
+// Entries with the same track are in order of insertion and the first one is returned
+template <typename T>
+typename multimap<int, T>::iterator closest_track(multimap<int, T>& requests, int head) {
+    typename multimap<int, T>::iterator above = requests.lower_bound(head);
+    if (above == requests.begin()) {
+        return above;
+    }
+    typename multimap<int, T>::iterator below = requests.lower_bound(prev(above)->first);
+    if (above == requests.end() || head - below->first <= above->first - head) {
+        return below;
+    }
+    return above;
+}
+
+class SSTFIOQueue final: public IOQueue {
+    public:
+        multimap<int, IORequest> requests; // By track
+
+        void push(const IORequest& request) {
+            requests.insert(make_pair(request.track, request));
+        }
+
+        bool empty() {
+            return requests.empty();
+        }
+
+        IORequest pop(int head, int now) {
+            multimap<int, IORequest>::iterator it = closest_track(requests, head);
+            IORequest request = it->second;
+            requests.erase(it);
+            return request;
+        }
+};
+
+// SSTF, except that the oldest request goes first once it waited more than deadline
+class DeadlineIOQueue final: public IOQueue {
+    public:
+        map<long long, IORequest> by_age; // Requests by order of arrival
+        multimap<int, long long> by_track; // Order of arrival of the requests, by track
+        long long next_seq = 0;
+        int deadline;
+
+        void push(const IORequest& request) {
+            by_age[next_seq] = request;
+            by_track.insert(make_pair(request.track, next_seq));
+            next_seq++;
+        }
+
+        bool empty() {
+            return by_age.empty();
+        }
+
+        IORequest pop(int head, int now) {
+            map<long long, IORequest>::iterator oldest = by_age.begin();
+            multimap<int, long long>::iterator chosen;
+            if (now - oldest->second.enqueue_time > deadline) {
+                chosen = by_track.lower_bound(oldest->second.track);
+                while (chosen->second != oldest->first) {
+                    chosen++;
+                }
+            } else {
+                chosen = closest_track(by_track, head);
+            }
+            map<long long, IORequest>::iterator it = by_age.find(chosen->second);
+            IORequest request = it->second;
+            by_age.erase(it);
+            by_track.erase(chosen);
+            return request;
+        }
+
+        DeadlineIOQueue(int deadline_) {
+            deadline = deadline_;
+        }
+};
+
+struct IODevice {
+    IOQueue* queue;
+    bool busy = false;
+    int head = 0; // Track of the head
+    double busy_time = 0;
+};
+
+struct IOSubsystem {
+    vector<IODevice> devices;
+    string policy; // F, S or D<deadline>
+    long long number_requests = 0;
+    double total_queue_wait = 0;
+    int max_queue_wait = 0;
+    // The tracks of the requests have their own stream (like the static priorities, see STEP 6)
+    // so the devices don't change the bursts drawn by the simulation
+    RandomStream random;
+
+    void record_wait(int queue_wait) {
+        number_requests++;
+        total_queue_wait += queue_wait;
+        max_queue_wait = max(max_queue_wait, queue_wait);
+    }
+
+    // IO: <devices> <policy> <requests> <average queue wait> <max queue wait> | <utilization of each device>
+    void print(OutputBuffer& out, int finishing_time) {
+        out.printf("IO: %d %s %lld %.2lf %d |", (int) devices.size(), policy.c_str(), number_requests,
+                number_requests > 0 ? total_queue_wait / number_requests : 0.0, max_queue_wait);
+        for (size_t device = 0; device < devices.size(); device++) {
+            out.printf(" %.2lf", finishing_time > 0 ? 100 * devices[device].busy_time / (double) finishing_time : 0.0);
+        }
+        out.printf("\n");
+    }
+
+    ~IOSubsystem() {
+        for (size_t device = 0; device < devices.size(); device++) {
+            delete devices[device].queue;
+        }
+    }
+};
+
+struct Simulator {
+    // State of the simulation. Nothing is shared with other simulations so they can run in parallel
+    DES_Layer des;
+    RandomStream random;
+    // Processes queue (in order of the file). 
+    // A process leaves the queue as soon as it is done and all the processes before it are done, so the queue only holds 
+    // the processes between the oldest process not done and the last arrival
+    queue<Process*> processes;
+    ArrivalSource* arrivals = nullptr; // Stream of the CREATED->READY events (see STEP 6)
+    OutputBuffer summary; // Summary lines
+
+    Simulator(EventQueue* event_queue, FILE* out):des(event_queue), summary(out), core_busy_time(1, 0) {}
+
+    // Track performance stats for printing ouput
+    struct Output {
+        int finishingTimeOfLastEvent = 0;
+
+        double cpuUtilization = 0;
+
+        double ioUtilization = 0;
+        // ioUtilization is harder to compute because multiple processes can be in blocked state.
+        int number_io_processes = 0; 
+        int start_of_IO_utilization; 
+        // When number_io_processes goes from 0 to 1, we store the time in start_of_IO_utilization
+        // When number_io_processes goes back to 0, we can compute the total duration of io utilization as CURRENT_TIME - start_of_IO_utilization
+
+        double avgTurnaroundTime = 0;
+        double avgCPUWaitingTime = 0;
+        double throughputPer100TimeUnits = 0;
+        int number_of_processes = 0; // Number of summary lines printed
+    };
+    Output output;
+
+    // Track current running process
+    Process* CURRENT_RUNNING_PROCESS = nullptr;
+
+    // track current time of simulation
+    int CURRENT_TIME = 0; 
+
+    // Number of events processed (for the benchmark mode)
+    long long number_events = 0;
+
+    // Trace of the -v, -t, -e and -p options (nullptr if none of them is given)
+    TraceBuffer* trace = nullptr;
+
+    // Latency histograms of the -L option (nullptr if not given). Printed after the SUM line
+    LatencyReport* latency = nullptr;
+
+    // IO devices of the -i option (nullptr : every process does its IO at once, on its own)
+    IOSubsystem* io = nullptr;
+
+    // Number of simulated cores (-c) and time spent running a process by each of them
+    int number_cores = 1;
+    vector<double> core_busy_time;
+
+    // Parallel mode (-P) : this simulator is the partition number partition of window (nullptr otherwise).
+    // The done processes wait in released and the IO busy intervals in io_intervals until the end of the window
+    PartitionWindow* window = nullptr;
+    int partition = 0;
+    queue<Process*> released;
+    vector<Process*> printed; // Processes printed at the end of the window, released by the thread of the partition
+    vector<IOInterval> io_intervals;
+
+    // Wait for the other partitions until next_time is in the current window (see STEP 13)
+    void wait_for_window(int next_time);
+
+    // The simulation loop is a template over the concrete scheduler type (see main).
+    // Every scheduler class is final so the calls to the scheduler are not virtual and can be inlined
+    template <typename SchedulerType, typename StatsType>
+    void simulation(SchedulerType* scheduler, StatsType& stats){
+
+        bool CALL_SCHEDULER = false; // Decide when scheduler needs to choose another process to run
+        if (SchedulerType::periodic_boost) {
+            put_boost_event(scheduler, stats);
+        }
+        put_arrival(stats);
+        Event* event = get_event(stats);
+        // while loop stop when event == 0 which happens at the end of the DES layer
+        while (event) {
+            // Parallel mode : the events after the current window wait for the other partitions (see STEP 13)
+            if (window != nullptr) {
+                wait_for_window(event->timestamp);
+            }
+            number_events++;
+            // MLFQ boost event : it has no process and doesn't change the running processes
+            if (SchedulerType::periodic_boost && event->process == nullptr) {
+                boost_run_queues(&scheduler, 1, event->timestamp, stats);
+            }
+            else if (process_event(scheduler, event, stats)) {
+                CALL_SCHEDULER = true;
+            }
+
+            if (CALL_SCHEDULER) {
+                // process the same time occuring events in order of appearance
+                if (des.get_next_time_event() == CURRENT_TIME) { 
+                    event = get_event(stats); 
+                    continue;
+                } 
+                // reset flag
+                CALL_SCHEDULER = false;
+                // Check if we need to fidn a new running process
+                if (CURRENT_RUNNING_PROCESS == nullptr) {
+                    size_t ready_processes = (trace != nullptr && trace->trace_sched) ? scheduler->size() : 0;
+                    stats.next_process(scheduler);
+                    CURRENT_RUNNING_PROCESS = scheduler->get_next_process();
+                    if (trace != nullptr && trace->trace_sched) {
+                        trace->sched(CURRENT_TIME, CURRENT_RUNNING_PROCESS == nullptr ? -1 : CURRENT_RUNNING_PROCESS->pid, ready_processes);
+                    }
+                    // If ready queue is empty, we get next event 
+                    // (!!! =/= end of simulation : maybe next event is CREATED->READY and we'll get a new running process !!!)
+                    if (CURRENT_RUNNING_PROCESS == nullptr) { 
+                        // If event is null then it's really the end of simulation
+                        event = get_event(stats); 
+                        continue; // go to next while iteration
+                    }
+                    // put the ready->running event for current time
+                    put_event( new Event(CURRENT_TIME, CURRENT_RUNNING_PROCESS, READY, RUNNING), stats);
+                }
+            }
+            // get next event
+            event = get_event(stats); 
+
+        } // end of while (event) loop
+
+
+    }; // end of simulation function
+
+    // The transition of the process of event in the single CPU loop. Returns true if the scheduler must choose the next running process
+    template <typename SchedulerType, typename StatsType>
+    bool process_event(SchedulerType* scheduler, Event* event, StatsType& stats) {
+        bool CALL_SCHEDULER = false; // Decide when scheduler needs to choose another process to run
+        Process* process = event->process;
+        CURRENT_TIME = event->timestamp;
+        State trans_to = event->new_state; // next transition state of the event
+        stats.transition(event->old_state, trans_to);
+        // The transitions to RUNNING and BLOCKED are traced once their burst is known
+        if (trace != nullptr && trace->verbose && (trans_to == READY || trans_to == DONE)) {
+            // A CREATED process has no clock yet : it arrives now
+            int time_in_state = (event->old_state == CREATED) ? 0 : CURRENT_TIME - process->clock;
+            trace->transition(CURRENT_TIME, process->pid, time_in_state, event->old_state, trans_to,
+                    process->remainingBurstTime, (int) process->remainingCPUtime, process->dynamic_prio);
+        }
+
+        // Update the performance stats
+        leave_state(event);
+        if (io != nullptr && event->old_state == BLOCKED) {
+            finish_io(process, stats);
+        }
+
+        // Check next state transition and do actions accordingly
+        switch (trans_to) {
+        case READY : {
+            // Add process to the runqueue
+            scheduler->add_process(process);
+            stats.process_ready(scheduler);
+
+            // Check if preempted from RUNNING state or not
+            if (process->remainingBurstTime > 0) {
+                CURRENT_RUNNING_PROCESS = nullptr; // We stop the process from running
+            }
+            // Else the process comes from BLOCKED or CREATED. 
+            // We need to deal with the special preemption case from E scheduler
+            // CURRENT_RUNNING_PROCESS != nullptr means that it doesn't come from the first CREATED process of the program
+            else if (SchedulerType::preemptive && CURRENT_RUNNING_PROCESS != nullptr) {
+                // This checks the dynamic priorities and if the current running process wasn't going to stop now
+                bool isPreemption = scheduler->test_preempt(CURRENT_RUNNING_PROCESS, process, CURRENT_TIME);
+                if (trace != nullptr && trace->trace_preempt) {
+                    trace->preempt(CURRENT_TIME, CURRENT_RUNNING_PROCESS->pid, process->pid,
+                            CURRENT_RUNNING_PROCESS->dynamic_prio < process->dynamic_prio,
+                            CURRENT_RUNNING_PROCESS->stopRunningTime, isPreemption);
+                }
+
+                if (isPreemption) {
+                    // If preemption happens, we need to remove the obsolete RUNNING->READY or RUNNING->BLOCKED event from the running process
+                    des.remove_event(CURRENT_RUNNING_PROCESS);
+                    stats.event_removed();
+                    if (trace != nullptr && trace->trace_events) {
+                        trace->remove_event(CURRENT_TIME, CURRENT_RUNNING_PROCESS->pid);
+                    }
+                    // We need to add the preemption event RUNNING -> READY
+                    put_event( new Event(CURRENT_TIME,
+                                                    CURRENT_RUNNING_PROCESS,
+                                                    RUNNING,
+                                                    READY), stats);
+                    // We need to update the CURRENT_RUNNING_PROCESS attributes
+                    // Since we preempt it, we store the remaining burst time it has
+                    CURRENT_RUNNING_PROCESS->remainingBurstTime += CURRENT_RUNNING_PROCESS->stopRunningTime - CURRENT_TIME;
+                    // We need to add the lost burst time to its remamining CPU time
+                    CURRENT_RUNNING_PROCESS->remainingCPUtime += CURRENT_RUNNING_PROCESS->stopRunningTime - CURRENT_TIME;
+                    // Finally, we set its stop running time to the current time since we preempt it now
+                    CURRENT_RUNNING_PROCESS->stopRunningTime = CURRENT_TIME;
+                }
+
+            }
+
+            CALL_SCHEDULER = true;
+            break;
+        }
+
+        case RUNNING : {
+
+            start_cpu_burst(scheduler, process, stats);
+            break;
+        }
+    
+        case BLOCKED : {
+            CURRENT_RUNNING_PROCESS = nullptr; // We stop the process from running
+            start_io_burst(process, stats);
+            // Call scheduler for next running process
+            CALL_SCHEDULER = true;
+
+            break;
+        }
+
+        case DONE : {
+            CURRENT_RUNNING_PROCESS = nullptr; // We stop the process form running
+            process->finishingTime = CURRENT_TIME;
+            process->turnaroundTime = CURRENT_TIME - process->arrivalTime;
+            process->done = true;
+            CALL_SCHEDULER = true; // Call scheduler for next running process
+            break;
+        }
+        case CREATED : {
+            cout << "hello, i'm here bcs I get a warning if i don't include CREATED in the switch statement" << endl;
+        }
+
+        }
+
+        process->clock = CURRENT_TIME; // update clock of process
+        // The summary lines of the processes are printed in order of the file
+        // print_done_processes can release the process so it is the last thing we do with it
+        if (trans_to == DONE) {
+            print_done_processes();
+        }
+        return CALL_SCHEDULER;
+    }
+
+    //-------------------- STEP 8 bis : Multi-core simulation --------------------
+    // -c N simulates N cores. Each core has its own run queue (its own scheduler object of the -s type) and its own running process.
+    // Placement : a process that becomes READY goes to an idle core if there is one, its previous core first (affinity).
+    // Otherwise it goes to the less loaded of its previous core and the next core of a round robin cursor (power of two choices),
+    // which balances the run queues without scanning every core.
+    // Work stealing : a core with an empty run queue takes the next process of the next non-empty run queue (the first one after it).
+    // The non-empty run queues are kept in a bitmap so a steal doesn't scan every core.
+    // The E preemption test is done against the running process of the core the process is put on.
+    // As in the single CPU loop, the cores pick their next process once all the events of the current time are processed
+    template <typename SchedulerType, typename StatsType>
+    void multicore_simulation(vector<SchedulerType*>& run_queues, StatsType& stats) {
+        number_cores = run_queues.size();
+        core_busy_time.assign(number_cores, 0);
+        vector<Process*> running(number_cores, nullptr); // Running process of each core
+        vector<int> queued(number_cores, 0); // Number of processes in each run queue
+        CoreSet loaded_cores(number_cores); // Cores with a non-empty run queue
+        CoreSet idle_cores(number_cores); // Cores with no running process and an empty run queue
+        for (int core = 0; core < number_cores; core++) {
+            idle_cores.insert(core);
+        }
+        vector<int> cores_to_schedule; // Cores whose running process stopped or whose run queue got a process
+        vector<bool> to_schedule(number_cores, false);
+        int cursor = 0; // Second choice of the placement
+
+        if (SchedulerType::periodic_boost) {
+            put_boost_event(run_queues[0], stats);
+        }
+        put_arrival(stats);
+        Event* event = get_event(stats);
+        while (event) {
+            // Parallel mode : the events after the current window wait for the other partitions (see STEP 13)
+            if (window != nullptr) {
+                wait_for_window(event->timestamp);
+            }
+            number_events++;
+            // MLFQ boost event : it has no process and doesn't change the running processes
+            if (SchedulerType::periodic_boost && event->process == nullptr) {
+                boost_run_queues(run_queues.data(), number_cores, event->timestamp, stats);
+            }
+            else {
+                int core = multicore_process_event(run_queues, event, running, queued, loaded_cores, idle_cores, cursor, stats);
+                if (core >= 0 && !to_schedule[core]) {
+                    to_schedule[core] = true;
+                    cores_to_schedule.push_back(core);
+                }
+            }
+
+            // Once every event of the current time is processed, the cores without running process pick their next one
+            if (!cores_to_schedule.empty() && des.get_next_time_event() != CURRENT_TIME) {
+                for (size_t i = 0; i < cores_to_schedule.size(); i++) {
+                    int free_core = cores_to_schedule[i];
+                    to_schedule[free_core] = false;
+                    if (running[free_core] != nullptr) {
+                        continue;
+                    }
+                    // Its own run queue first, else steal from the next non-empty one
+                    Process* next_process = nullptr;
+                    int victim = (queued[free_core] > 0) ? free_core : loaded_cores.next(free_core);
+                    size_t ready_processes = 0; // Size of the run queue the process is taken from
+                    if (victim >= 0) {
+                        ready_processes = (trace != nullptr && trace->trace_sched) ? run_queues[victim]->size() : 0;
+                        stats.next_process(run_queues[victim]);
+                        next_process = run_queues[victim]->get_next_process();
+                        queued[victim]--;
+                        if (queued[victim] == 0) {
+                            loaded_cores.erase(victim);
+                        }
+                        if (victim != free_core) {
+                            stats.process_stolen();
+                        }
+                    }
+                    if (trace != nullptr && trace->trace_sched) {
+                        trace->sched(CURRENT_TIME, next_process == nullptr ? -1 : next_process->pid, ready_processes);
+                    }
+                    if (next_process == nullptr) {
+                        idle_cores.insert(free_core);
+                        continue;
+                    }
+                    next_process->core = free_core;
+                    running[free_core] = next_process;
+                    put_event(new Event(CURRENT_TIME, next_process, READY, RUNNING), stats);
+                }
+                cores_to_schedule.clear();
+            }
+
+            event = get_event(stats);
+        }
+    }
+
+    // The transition of the process of event in the multi-core loop (running, queued, loaded_cores, idle_cores and cursor are
+    // the state of the cores in multicore_simulation). Returns the core that must pick its next process, -1 if none
+    template <typename SchedulerType, typename StatsType>
+    int multicore_process_event(vector<SchedulerType*>& run_queues, Event* event, vector<Process*>& running, vector<int>& queued,
+            CoreSet& loaded_cores, CoreSet& idle_cores, int& cursor, StatsType& stats) {
+        Process* process = event->process;
+        CURRENT_TIME = event->timestamp;
+        State trans_to = event->new_state;
+        stats.transition(event->old_state, trans_to);
+        if (trace != nullptr && trace->verbose && (trans_to == READY || trans_to == DONE)) {
+            int time_in_state = (event->old_state == CREATED) ? 0 : CURRENT_TIME - process->clock;
+            trace->transition(CURRENT_TIME, process->pid, time_in_state, event->old_state, trans_to,
+                    process->remainingBurstTime, (int) process->remainingCPUtime, process->dynamic_prio);
+        }
+        leave_state(event);
+        if (io != nullptr && event->old_state == BLOCKED) {
+            finish_io(process, stats);
+        }
+
+        int core = process->core;
+        switch (trans_to) {
+        case READY : {
+            if (event->old_state == RUNNING) {
+                // Preempted : the process goes back in the run queue of its core
+                running[core] = nullptr;
+            }
+            else if (!idle_cores.contains(core)) {
+                int idle_core = idle_cores.first();
+                if (idle_core >= 0) {
+                    core = idle_core;
+                }
+                else {
+                    int other_core = cursor;
+                    cursor = (cursor + 1) % number_cores;
+                    if (queued[other_core] < queued[core]) {
+                        core = other_core;
+                    }
+                }
+            }
+            process->core = core;
+            run_queues[core]->add_process(process);
+            queued[core]++;
+            loaded_cores.insert(core);
+            idle_cores.erase(core);
+            stats.process_ready(run_queues[core]);
+
+            Process* current = running[core];
+            if (SchedulerType::preemptive && event->old_state != RUNNING && current != nullptr) {
+                bool isPreemption = run_queues[core]->test_preempt(current, process, CURRENT_TIME);
+                if (trace != nullptr && trace->trace_preempt) {
+                    trace->preempt(CURRENT_TIME, current->pid, process->pid, current->dynamic_prio < process->dynamic_prio,
+                            current->stopRunningTime, isPreemption);
+                }
+                if (isPreemption) {
+                    des.remove_event(current);
+                    stats.event_removed();
+                    if (trace != nullptr && trace->trace_events) {
+                        trace->remove_event(CURRENT_TIME, current->pid);
+                    }
+                    put_event(new Event(CURRENT_TIME, current, RUNNING, READY), stats);
+                    // Unlike the single CPU loop, a process preempted during a new cpu burst (remainingBurstTime is -1 or 0) 
+                    // keeps the rest of the burst
+                    current->remainingBurstTime = max(current->remainingBurstTime, 0) + current->stopRunningTime - CURRENT_TIME;
+                    current->remainingCPUtime += current->stopRunningTime - CURRENT_TIME;
+                    current->stopRunningTime = CURRENT_TIME;
+                }
+            }
+            break;
+        }
+        case RUNNING : {
+            start_cpu_burst(run_queues[core], process, stats);
+            break;
+        }
+        case BLOCKED : {
+            running[core] = nullptr;
+            start_io_burst(process, stats);
+            break;
+        }
+        case DONE : {
+            running[core] = nullptr;
+            process->finishingTime = CURRENT_TIME;
+            process->turnaroundTime = CURRENT_TIME - process->arrivalTime;
+            process->done = true;
+            break;
+        }
+        case CREATED : {
+            break;
+        }
+        }
+
+        process->clock = CURRENT_TIME;
+        // print_done_processes can release the process so it is the last thing we do with it
+        if (trans_to == DONE) {
+            print_done_processes();
+        }
+        return trans_to != RUNNING ? core : -1;
+    }
+
+    //-------------------- Steps of the simulation loops --------------------
+    // Shared by the single CPU loop and the multi-core loop (see STEP 8 bis)
+
+    // Update the performance stats when the process of event leaves its old state
+    void leave_state(Event* event) {
+        Process* process = event->process;
+        if (event->old_state == RUNNING) { 
+            // By construction, process->clock is the time when the process entered the running state
+            output.cpuUtilization += (double) CURRENT_TIME - (double) process->clock; 
+            core_busy_time[process->core] += (double) CURRENT_TIME - (double) process->clock;
+        }
+        if (event->old_state == BLOCKED) { 
+            output.number_io_processes--;
+            if (output.number_io_processes == 0) {
+                // No more processes in block state so we can compute the duration of io utilization between
+                // last process and first process
+                output.ioUtilization += (double) CURRENT_TIME - (double) output.start_of_IO_utilization;
+                if (window != nullptr) {
+                    io_intervals.push_back(IOInterval{output.start_of_IO_utilization, CURRENT_TIME});
+                }
+            }
+        }
+    }
+
+    // The process enters the RUNNING state : compute its cpu burst and put the event that ends it
+    template <typename SchedulerType, typename StatsType>
+    void start_cpu_burst(SchedulerType* scheduler, Process* process, StatsType& stats) {
+        // Update CPU waiting time to compute average performance later
+        // process->clock is the time the process was added in READY state
+        process->cpuWaitingTime += CURRENT_TIME - process->clock;
+        if (latency != nullptr) {
+            latency->ready_wait.record(CURRENT_TIME - process->clock);
+        }
+
+        int cpu_burst_duration;
+        int quantum = scheduler->time_slice(process);
+        bool TO_BE_PREEMPTED;
+
+        // 4 CASES of cpu burst duration:
+        // CASE 1 : Process was preempted and the remaining cpu burst time is HIGHER than the quantum
+        //      => We give a quantum burst time and we reduce the remaining cpu burst time
+        if (process->remainingBurstTime > 0 && process->remainingBurstTime > quantum) {
+            cpu_burst_duration = quantum;
+            process->remainingBurstTime -= quantum;
+            TO_BE_PREEMPTED = true;
+        }
+        // CASE 2 : Process was preempted and the remaining cpu burst time is LOWER than the quantum
+        //      => We give the remaining cpu burst time
+        else if (process->remainingBurstTime > 0 && process->remainingBurstTime <= quantum) {
+            cpu_burst_duration = process->remainingBurstTime;
+            process->remainingBurstTime = 0;
+            TO_BE_PREEMPTED = false;
+        }
+        // CASE 3 AND 4 : Process was not preempted so we compute a new random cpu burst duration
+        else {
+            cpu_burst_duration = random.get_random_number(process->cpuBurst);
+            stats.random_number();
+            // CASE 3 : random cpu burst duration is HIGHER than quantum
+            //      => We give a quantum burst duration and we mark the process to be preempted
+            if (cpu_burst_duration > quantum) {
+                process->remainingBurstTime = cpu_burst_duration - quantum;
+                cpu_burst_duration = quantum;
+                TO_BE_PREEMPTED = true;
+            }
+            // CASE 4 : random cpu burst duration is LOWER than quantum
+            //      => We don't do anything
+            else {
+                TO_BE_PREEMPTED = false;
+            }
+        }
+
+        if (trace != nullptr && trace->verbose) {
+            trace->transition(CURRENT_TIME, process->pid, CURRENT_TIME - process->clock, READY, RUNNING,
+                    cpu_burst_duration, (int) process->remainingCPUtime, process->dynamic_prio);
+        }
+
+        // Now we check if it's going to be blocked, preempted or if it's going to be done
+        //// Check if the job will be done
+        if (process->remainingCPUtime <= cpu_burst_duration) {
+            cpu_burst_duration = process->remainingCPUtime;
+            put_event( new Event(CURRENT_TIME+cpu_burst_duration, 
+                                            process,
+                                            RUNNING,
+                                            DONE), stats);
+            //// We reset the remaining burst time and cpu time since the job will be done
+            process->remainingBurstTime = 0;
+            process->remainingCPUtime = 0;
+        }
+        //// Check if the job will be preempted
+        else if (TO_BE_PREEMPTED) {
+            // Create preemption event RUNNING -> READY
+            put_event( new Event(CURRENT_TIME + cpu_burst_duration,
+                                            process,
+                                            RUNNING,
+                                            READY), stats);
+            process->remainingCPUtime -= cpu_burst_duration;
+        }
+        //// If not preempted or done, it means it's gonna be blocked
+        else {
+            // Create block event RUNNING -> BLOCKED
+            put_event( new Event(CURRENT_TIME + cpu_burst_duration, 
+                                            process,
+                                            RUNNING,
+                                            BLOCKED), stats);
+            process->remainingCPUtime -= cpu_burst_duration;
+        }
+
+        // Finally, we store the time when the process will stop running
+        // We need to store this value to check if the E scheduler will preempt the process with a new READY process
+        process->stopRunningTime = CURRENT_TIME + cpu_burst_duration;
+    }
+
+    // The process enters the BLOCKED state : compute its io burst and put the BLOCKED->READY event
+    template <typename StatsType>
+    void start_io_burst(Process* process, StatsType& stats) {
+        // Increment number of processes in BLOCKED state. Used to compute the average IO utilization
+        output.number_io_processes += 1; 
+        // If it's the first process that uses IO, we record the start time. Used to compute the average IO utilization
+        if (output.number_io_processes == 1) {
+            output.start_of_IO_utilization = CURRENT_TIME;
+        }
+        // Compute random io burst time
+        int io_burst_duration = random.get_random_number(process->ioBurst);
+        stats.random_number();
+
+        if (trace != nullptr && trace->verbose) {
+            trace->transition(CURRENT_TIME, process->pid, CURRENT_TIME - process->clock, RUNNING, BLOCKED,
+                    io_burst_duration, (int) process->remainingCPUtime);
+        }
+
+        // With IO devices, the process waits for its device
+        if (io != nullptr) {
+            request_io(process, io_burst_duration, stats);
+            return;
+        }
+
+        // update IO waiting time
+        process->ioWaitingTime += io_burst_duration;
+
+        // Create BLOCKED -> RDY event
+        put_event( new Event(CURRENT_TIME+io_burst_duration, 
+                            process,
+                            BLOCKED,
+                            READY), stats);
+    }
+
+    // The process asks its device for io_burst_duration of transfer (-i)
+    template <typename StatsType>
+    void request_io(Process* process, int io_burst_duration, StatsType& stats) {
+        IORequest request;
+        request.process = process;
+        request.track = io->random.get_random_number(NUMBER_TRACKS) - 1;
+        stats.random_number();
+        request.io_burst = io_burst_duration;
+        request.enqueue_time = CURRENT_TIME;
+        IODevice& device = io->devices[process->pid % io->devices.size()];
+        if (device.busy) {
+            device.queue->push(request);
+        } else {
+            start_io(device, request, stats);
+        }
+    }
+
+    // The device serves request : put the BLOCKED->READY event at the end of the seek and the transfer
+    template <typename StatsType>
+    void start_io(IODevice& device, const IORequest& request, StatsType& stats) {
+        int queue_wait = CURRENT_TIME - request.enqueue_time;
+        int service_time = abs(request.track - device.head) / TRACKS_PER_TIME_UNIT + request.io_burst;
+        device.busy = true;
+        device.head = request.track;
+        device.busy_time += service_time;
+        // The IO time of the process is the whole time in BLOCKED state
+        request.process->ioWaitingTime += queue_wait + service_time;
+        io->record_wait(queue_wait);
+        if (latency != nullptr) {
+            latency->io_queue_wait.record(queue_wait);
+        }
+        put_event(new Event(CURRENT_TIME + service_time, request.process, BLOCKED, READY), stats);
+    }
+
+    // The IO of process is over : its device serves the next request of its queue
+    template <typename StatsType>
+    void finish_io(Process* process, StatsType& stats) {
+        IODevice& device = io->devices[process->pid % io->devices.size()];
+        device.busy = false;
+        if (!device.queue->empty()) {
+            start_io(device, device.queue->pop(device.head, CURRENT_TIME), stats);
+        }
+    }
+
+    // MLFQ : the next boost is a DES event so it is processed in order with the events of the processes
+    template <typename SchedulerType, typename StatsType>
+    void put_boost_event(SchedulerType* scheduler, StatsType& stats) {
+        put_event(new Event(CURRENT_TIME + scheduler->boost_period, nullptr, READY, READY), stats);
+    }
+
+    // MLFQ boost event : boost every run queue (the cores boost together) and put the next boost event.
+    // The running and blocked processes always have an event in the DES layer, so once no event is left and every run queue
+    // is empty, every process is done : this last boost is dropped without moving the clock (the finishing time stays
+    // the time of the last DONE event) and there is no next boost
+    template <typename SchedulerType, typename StatsType>
+    void boost_run_queues(SchedulerType** run_queues, int number_queues, int timestamp, StatsType& stats) {
+        size_t ready_processes = 0;
+        for (int core = 0; core < number_queues; core++) {
+            ready_processes += run_queues[core]->size();
+        }
+        if (ready_processes == 0 && des.get_next_time_event() == -1) {
+            return;
+        }
+        CURRENT_TIME = timestamp;
+        for (int core = 0; core < number_queues; core++) {
+            run_queues[core]->boost();
+        }
+        if (trace != nullptr && trace->trace_sched) {
+            trace->boost(CURRENT_TIME, ready_processes);
+        }
+        put_boost_event(run_queues[0], stats);
+    }
+
+    // The next arrival of the input file goes in the DES layer (see STEP 5) like the events put by the simulation loop
+    template <typename StatsType>
+    void put_arrival(StatsType& stats) {
+        Event* arrival = arrivals->next_arrival();
+        des.put_arrival(arrival);
+        if (arrival != nullptr) {
+            stats.random_number(); // The static priority of the process (see ProcessReader)
+            stats.event_queued(des);
+            if (trace != nullptr && trace->trace_events) {
+                trace->add_event(arrival->timestamp, arrival->process->pid, arrival->old_state, arrival->new_state, des.events->size());
+            }
+        }
+    }
+
+    // Next event of the DES layer. Once an arrival is taken, the next one is put
+    template <typename StatsType>
+    Event* get_event(StatsType& stats) {
+        Event* event = des.get_event();
+        if (event != nullptr && event->old_state == CREATED) {
+            put_arrival(stats);
+        }
+        return event;
+    }
+
+    // Every event of the simulation loop goes through here so the stats and the trace see the depth of the DES layer
+    template <typename StatsType>
+    void put_event(Event* event, StatsType& stats) {
+        des.put_event(event);
+        stats.event_queued(des);
+        if (trace != nullptr && trace->trace_events) {
+            trace->add_event(event->timestamp, event->process == nullptr ? -1 : event->process->pid, 
+                    event->old_state, event->new_state, des.events->size());
+        }
+    }
+
+    //-------------------- STEP 9 : Print Summary --------------------
+
+    // Print the summary line of a process and release it
+    void print_process(Process* process) {
+        format_process(process);
+        delete process; // The process is not needed anymore
+    }
+
+    // Print the summary line of a process
+    // The averages are accumulated in order of the file
+    void format_process(Process* process) {
+        output.avgTurnaroundTime += (double) process->turnaroundTime; // to compute average later
+        output.avgCPUWaitingTime += (double) process->cpuWaitingTime; // to comput average later
+        output.number_of_processes++;
+        if (latency != nullptr) {
+            latency->turnaround.record(process->turnaroundTime);
+            latency->cpu_wait.record(process->cpuWaitingTime);
+            latency->io_wait.record(process->ioWaitingTime);
+        }
+        summary.printf("%04d: %4d %4d %4d %4d %1d | %5d %5d %5d %5d\n", 
+                process->pid,
+                process->arrivalTime,
+                process->totalCPUTime,
+                process->cpuBurst,
+                process->ioBurst,
+                process->static_prio,
+                process->finishingTime,
+                process->turnaroundTime,
+                process->ioWaitingTime,
+                process->cpuWaitingTime
+            );
+    }
+
+    // Print the processes at the front of the processes queue that are done
+    void print_done_processes() {
+        while (!processes.empty() && processes.front()->done) {
+            if (window != nullptr) {
+                released.push(processes.front()); // Printed in pid order at the end of the window
+            } else {
+                print_process(processes.front());
+            }
+            processes.pop();
+        }
+    }
+
+    void print_summary() {
+
+        // Print the processes left (only the ones that never reached the DONE state)
+        while (!processes.empty()) {
+            print_process(processes.front());
+            processes.pop();
+        }
+
+        // total number of processes (used to compute the averages)
+        double number_of_processes = output.number_of_processes;
+
+        // Compute average turn around time and average cpu waiting time (0 for an input file without processes)
+        if (number_of_processes > 0) {
+            output.avgTurnaroundTime /= number_of_processes;
+            output.avgCPUWaitingTime /= number_of_processes;
+        }
+
+        // By construciton, the finishing time of last event is stored in the CURRENT_TIME of last while loop iteration
+        output.finishingTimeOfLastEvent = CURRENT_TIME;
+
+        // The ratios are 0 when the simulation doesn't last (no processes)
+        if (output.finishingTimeOfLastEvent > 0) {
+            // Compute the CPU and IO utlization ratio
+            output.cpuUtilization = 100 * output.cpuUtilization / ((double) output.finishingTimeOfLastEvent * number_cores);
+            output.ioUtilization = 100 * output.ioUtilization / (double) output.finishingTimeOfLastEvent;
+
+            // Compute the throughput per 100 time units
+            output.throughputPer100TimeUnits = 100 * number_of_processes / (double) output.finishingTimeOfLastEvent;
+        }
+
+
+        // Print summary
+        summary.printf("SUM: %d %.2lf %.2lf %.2lf %.2lf %.3lf",
+                output.finishingTimeOfLastEvent,
+                output.cpuUtilization,
+                output.ioUtilization,
+                output.avgTurnaroundTime,
+                output.avgCPUWaitingTime,
+                output.throughputPer100TimeUnits
+            );
+        // With several cores the CPU utilization is the average of the cores, followed by the utilization of each core
+        if (number_cores > 1) {
+            summary.printf(" |");
+            for (int core = 0; core < number_cores; core++) {
+                summary.printf(" %.2lf", output.finishingTimeOfLastEvent > 0 ? 100 * core_busy_time[core] / (double) output.finishingTimeOfLastEvent : 0.0);
+            }
+        }
+        summary.printf("\n");
+        if (io != nullptr) {
+            io->print(summary, output.finishingTimeOfLastEvent);
+        }
+        if (latency != nullptr) {
+            latency->print(summary);
+        }
+        summary.flush();
+
+    } // end of print_summary function
+
+}; // End of simulator struct
+
+
+
+//-------------------- STEP 10 : Run a simulation --------------------
+
+// Build the scheduler of a -s spec. Returns nullptr (after printing the reason) if the spec is not valid
+Scheduler* create_scheduler(const string& svalue) {
+    switch (svalue[0]) {
+        case 'F' : {
+            return new FCFS();
+        }
+        case 'L' : {
+            return new LCFS();
+        }
+        case 'S' : {
+            return new SRTF();
+        }
+        case 'R' : {
+            int quantum = -1;
+            sscanf(svalue.c_str(), "R%d", &quantum);
+            if (quantum == -1) {
+                cout << "You must give a quantum for Round Robin scheduler" << endl;
+                return nullptr;
+            }            
+            return new RR(quantum);
+        }
+        case 'P' : {
+            int quantum = -1;
+            int maxprio = 4;
+            if (svalue.find(':') != string::npos){ 
+                sscanf(svalue.c_str(), "P%d:%d", &quantum, &maxprio); 
+            }
+            else { 
+                sscanf(svalue.c_str(), "P%d", &quantum); 
+            }
+
+            if (quantum == -1) {
+                cout << "You must give a quantum for PRIO scheduler" << endl;
+                return nullptr;
+            }
+            return new PRIO(quantum, maxprio);
+        }
+        case 'E' : {
+            int quantum = -1;
+            int maxprio = 4;
+            if (svalue.find(':') != string::npos){ 
+                sscanf(svalue.c_str(), "E%d:%d", &quantum, &maxprio); 
+            }
+            else { 
+                sscanf(svalue.c_str(), "E%d", &quantum); 
+            }
+
+            if (quantum == -1) {
+                cout << "You must give a quantum for PREPRIO scheduler" << endl;
+                return nullptr;
+            }
+            return new PREPRIO(quantum, maxprio);
+        }
+        case 'C' : {
+            // C[<target latency>[:<minimum granularity>]] : target latency and minimum granularity are optional
+            int target_latency = 24;
+            int min_granularity = 3;
+            const char* spec = svalue.c_str() + 1;
+            int consumed = 0;
+            if (sscanf(spec, "%d%n", &target_latency, &consumed) == 1) {
+                spec += consumed;
+                if (*spec == ':' && sscanf(spec, ":%d%n", &min_granularity, &consumed) == 1) {
+                    spec += consumed;
+                }
+            }
+            if (*spec != '\0') {
+                cout << "You must give the CFS scheduler as C[<target latency>[:<minimum granularity>]]" << endl;
+                return nullptr;
+            }
+            if (target_latency < 1 || min_granularity < 1) {
+                cout << "The target latency and the minimum granularity of CFS scheduler must be positive" << endl;
+                return nullptr;
+            }
+            return new CFS(target_latency, min_granularity);
+        }
+        case 'M' : {
+            // M[<quantum of the top level>,<quantum of the next level>,...][:<boost period>]
+            vector<int> quanta;
+            int boost_period = 100;
+            const char* spec = svalue.c_str() + 1;
+            if (*spec != '\0' && *spec != ':') {
+                int consumed = 0;
+                int quantum = -1;
+                while (sscanf(spec, "%d%n", &quantum, &consumed) == 1) {
+                    quanta.push_back(quantum);
+                    spec += consumed;
+                    if (*spec != ',') {
+                        break;
+                    }
+                    spec++;
+                }
+                // A comma must be followed by a quantum
+                if (*(spec - 1) == ',') {
+                    quanta.clear();
+                }
+            }
+            else {
+                int default_quanta[] = {2, 4, 8, 16};
+                quanta.assign(default_quanta, default_quanta + 4);
+            }
+            if (*spec == ':') {
+                boost_period = -1;
+                int consumed = 0;
+                sscanf(spec, ":%d%n", &boost_period, &consumed);
+                spec += consumed;
+            }
+            if (quanta.empty() || *spec != '\0') {
+                cout << "You must give the quanta of MLFQ scheduler as M<quantum>,<quantum>,...[:<boost period>]" << endl;
+                return nullptr;
+            }
+            for (size_t level = 0; level < quanta.size(); level++) {
+                if (quanta[level] < 1) {
+                    cout << "The quanta of MLFQ scheduler must be positive" << endl;
+                    return nullptr;
+                }
+            }
+            if (boost_period < 1) {
+                cout << "The boost period of MLFQ scheduler must be positive" << endl;
+                return nullptr;
+            }
+            return new MLFQ(quanta, boost_period);
+        }
+        default : {
+            cout << "Scheduler doesn't exist. Choose between F,L,S,RR,P,E,C and M" << endl;
+            return nullptr;
+        }
+    }
+}
+
+// Build the event queue engine of the DES layer of a -q option. Returns nullptr (after printing the reason) if the engine doesn't exist
+EventQueue* create_event_queue(char qvalue) {
+    switch (qvalue) {
+        case 'L' : {
+            return new ListEventQueue();
+        }
+        case 'H' : {
+            return new HeapEventQueue();
+        }
+        case 'W' : {
+            return new WheelEventQueue();
+        }
+        default : {
+            cout << "Event queue doesn't exist. Choose between L,H and W" << endl;
+            return nullptr;
+        }
+    }
+}
+
+// Build the IO devices of a -i spec <devices>:<policy> where policy is F, S or D<deadline>.
+// Returns nullptr (after printing the reason) if the spec is not valid
+IOSubsystem* create_io_subsystem(const string& ivalue) {
+    int number_devices = 0;
+    char policy = 0;
+    int deadline = -1;
+    int length = 0; // Characters read
+    sscanf(ivalue.c_str(), "%d:%c%n", &number_devices, &policy, &length);
+    if (policy == 'D') {
+        int deadline_length = 0;
+        sscanf(ivalue.c_str() + length, "%d%n", &deadline, &deadline_length);
+        length += deadline_length;
+    }
+    if (number_devices < 1) {
+        cout << "You must give a positive number of IO devices (-i <devices>:<policy>)" << endl;
+        return nullptr;
+    }
+    if (policy != 'F' && policy != 'S' && policy != 'D') {
+        cout << "IO queue policy doesn't exist. Choose between F,S and D<deadline>" << endl;
+        return nullptr;
+    }
+    if (policy == 'D' && deadline < 0) {
+        cout << "You must give a deadline for the D IO queue policy" << endl;
+        return nullptr;
+    }
+    if (length != (int) ivalue.size()) {
+        cout << "Unexpected characters in the IO devices spec " << ivalue << endl;
+        return nullptr;
+    }
+    IOSubsystem* io = new IOSubsystem();
+    io->policy = ivalue.substr(ivalue.find(':') + 1);
+    io->devices.resize(number_devices);
+    for (int device = 0; device < number_devices; device++) {
+        switch (policy) {
+            case 'F' : {
+                io->devices[device].queue = new FIFOIOQueue();
+                break;
+            }
+            case 'S' : {
+                io->devices[device].queue = new SSTFIOQueue();
+                break;
+            }
+            case 'D' : {
+                io->devices[device].queue = new DeadlineIOQueue(deadline);
+                break;
+            }
+        }
+    }
+    return io;
+}
+
+// Time spent in each phase of a run and size of the run (for the benchmark mode)
+// The processes are created and their summary lines printed during the simulation, so these costs are in simulation_seconds
+struct RunStats {
+    double simulation_seconds = 0;
+    double summary_seconds = 0; // Processes left and SUM line
+    long long number_events = 0;
+};
+
+double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Multi-core loop over the run queues of the cores, with the concrete scheduler type
+template <typename SchedulerType, typename StatsType>
+void run_multicore(Simulator& simulator, vector<Scheduler*>& cores, StatsType& stats) {
+    vector<SchedulerType*> run_queues(cores.size());
+    for (size_t core = 0; core < cores.size(); core++) {
+        run_queues[core] = static_cast<SchedulerType*>(cores[core]);
+    }
+    simulator.multicore_simulation(run_queues, stats);
+}
+
+// We dispatch once on the scheduler type so the simulation loop is compiled for each scheduler (and each stats policy)
+// cores has one scheduler per simulated core. With a single core we use the single CPU loop
+template <typename StatsType>
+void dispatch_simulation(Simulator& simulator, const string& svalue, vector<Scheduler*>& cores, StatsType& stats) {
+    bool multicore = cores.size() > 1;
+    switch (svalue[0]) {
+        case 'F' : {
+            multicore ? run_multicore<FCFS>(simulator, cores, stats) : simulator.simulation(static_cast<FCFS*>(cores[0]), stats);
+            break;
+        }
+        case 'L' : {
+            multicore ? run_multicore<LCFS>(simulator, cores, stats) : simulator.simulation(static_cast<LCFS*>(cores[0]), stats);
+            break;
+        }
+        case 'S' : {
+            multicore ? run_multicore<SRTF>(simulator, cores, stats) : simulator.simulation(static_cast<SRTF*>(cores[0]), stats);
+            break;
+        }
+        case 'R' : {
+            multicore ? run_multicore<RR>(simulator, cores, stats) : simulator.simulation(static_cast<RR*>(cores[0]), stats);
+            break;
+        }
+        case 'P' : {
+            multicore ? run_multicore<PRIO>(simulator, cores, stats) : simulator.simulation(static_cast<PRIO*>(cores[0]), stats);
+            break;
+        }
+        case 'E' : {
+            multicore ? run_multicore<PREPRIO>(simulator, cores, stats) : simulator.simulation(static_cast<PREPRIO*>(cores[0]), stats);
+            break;
+        }
+        case 'C' : {
+            multicore ? run_multicore<CFS>(simulator, cores, stats) : simulator.simulation(static_cast<CFS*>(cores[0]), stats);
+            break;
+        }
+        case 'M' : {
+            multicore ? run_multicore<MLFQ>(simulator, cores, stats) : simulator.simulation(static_cast<MLFQ*>(cores[0]), stats);
+            break;
+        }
+    }
+}
+
+// Simulate the processes of input_file with the scheduler of svalue and write the output in out
+// The random numbers must be loaded, svalue and qvalue must be valid and input_file must have been checked by check_input_file
+// (number_processes is its number of processes). Batch modes check each input file once for all its runs
+// If stats is not nullptr, it gets the timings of the run
+// If counters is not nullptr, the simulation loop is the instrumented one and counters gets its counts (-S)
+// If trace is not nullptr, the simulation appends its trace to it (-v, -t, -e, -p). The trace is flushed at the end of the simulation
+// If latency is not nullptr, it records the latencies and the percentiles are printed after the SUM line (-L)
+// number_cores is the number of simulated cores (-c), each with its own scheduler
+// If io is not nullptr, the processes wait for its devices to do their IO (-i)
+void run_simulation(const string& svalue, char qvalue, const MappedFile& input_file, int number_processes, FILE* out, RunStats* stats = nullptr, 
+        SimulationStats* counters = nullptr, TraceBuffer* trace = nullptr, LatencyReport* latency = nullptr, int number_cores = 1,
+        IOSubsystem* io = nullptr) {
+    vector<Scheduler*> cores(number_cores);
+    for (int core = 0; core < number_cores; core++) {
+        cores[core] = create_scheduler(svalue);
+    }
+    Scheduler* scheduler = cores[0]; // Gives the static priorities and prints the name
+    Simulator simulator(create_event_queue(qvalue), out); // Our simulator
+    simulator.trace = trace;
+    simulator.latency = latency;
+    simulator.io = io;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // Stream the processes of the input file in the DES layer
+    ProcessReader reader(input_file, scheduler, simulator.processes);
+    simulator.arrivals = &reader;
+    // The first random numbers are the static priorities of the processes so the simulation starts after them
+    simulator.random.ofs = number_processes % total_random_num;
+    // The tracks of the IO requests start in the middle of the random numbers
+    if (io != nullptr) {
+        io->random.ofs = total_random_num / 2;
+    }
+
+    // The summary lines are printed during the simulation so we print the scheduler name (and quantum) first
+    scheduler->print_scheduler(out);
+
+    // Start the simulation
+    if (counters != nullptr) {
+        dispatch_simulation(simulator, svalue, cores, *counters);
+        counters->number_boosts = cores[0]->number_boosts;
+    } else {
+        NoStats no_stats;
+        dispatch_simulation(simulator, svalue, cores, no_stats);
+    }
+    if (trace != nullptr) {
+        trace->flush();
+    }
+
+    if (stats != nullptr) {
+        stats->simulation_seconds = seconds_since(start);
+        stats->number_events = simulator.number_events;
+        start = chrono::steady_clock::now();
+    }
+
+    // Print the summary
+    simulator.print_summary(); // print the summary
 
-struct Simulator {
-    // Track performance stats for printing ouput
-    struct Output {
-        int finishingTimeOfLastEvent = 0;
+    if (stats != nullptr) {
+        stats->summary_seconds = seconds_since(start);
+    }
 
-        double cpuUtilization = 0;
+    for (int core = 0; core < number_cores; core++) {
+        delete cores[core];
+    }
+}
 
-        double ioUtilization = 0;
-        // ioUtilization is harder to compute because multiple processes can be in blocked state.
-        int number_io_processes = 0; 
-        int start_of_IO_utilization; 
-        // When number_io_processes goes from 0 to 1, we store the time in start_of_IO_utilization
-        // When number_io_processes goes back to 0, we can compute the total duration of io utilization as CURRENT_TIME - start_of_IO_utilization
+// Options of the runs of the batch, benchmark and test modes other than the scheduler spec
+struct RunOptions {
+    int number_cores = 1; // -c
+    int number_partitions = 0; // -P (0 : no parallel mode)
+    string ivalue; // -i (empty : no IO devices)
+
+    // Suffix of the output names of the batch and test modes, empty for the original single CPU simulation
+    string name() const {
+        string name;
+        if (number_cores > 1) {
+            name += "_c" + to_string(number_cores);
+        }
+        if (number_partitions > 0) {
+            name += "_P" + to_string(number_partitions);
+        }
+        if (!ivalue.empty()) {
+            string devices = ivalue;
+            replace(devices.begin(), devices.end(), ':', '_');
+            name += "_i" + devices;
+        }
+        return name;
+    }
+};
 
-        double avgTurnaroundTime = 0;
-        double avgCPUWaitingTime = 0;
-        double throughputPer100TimeUnits = 0;
-    };
-    Output output;
+void run_partitions(const string& svalue, char qvalue, const MappedFile& input_file, int number_processes, FILE* out, int number_cores, int number_partitions,
+        RunStats* stats = nullptr); // See STEP 13
+
+// One run of the batch, benchmark and test modes
+void run_job(const string& svalue, char qvalue, const MappedFile& input_file, int number_processes, FILE* out, const RunOptions& options,
+        RunStats* stats = nullptr) {
+    if (options.number_partitions > 0) {
+        run_partitions(svalue, qvalue, input_file, number_processes, out, options.number_cores, options.number_partitions, stats);
+    } else {
+        // The devices keep the state of their queues so each run gets its own (the spec was checked before)
+        IOSubsystem* io = options.ivalue.empty() ? nullptr : create_io_subsystem(options.ivalue);
+        run_simulation(svalue, qvalue, input_file, number_processes, out, stats, nullptr, nullptr, nullptr, options.number_cores, io);
+        delete io;
+    }
+}
 
-    // Track current running process
-    Process* CURRENT_RUNNING_PROCESS = nullptr;
+// One (input file, scheduler spec) pair of the batch mode
+struct BatchJob {
+    const MappedFile* input_file;
+    int number_processes; // Of the input file, checked once for all its jobs
+    string svalue;
+    RunOptions options;
+    string output_name;
+};
 
-    // track current time of simulation
-    int CURRENT_TIME; 
+// Run the jobs of the batch mode on number_threads threads. Returns false if an output file couldn't be written
+// The simulations don't share any state, so every output is the same as in a serial run
+bool run_batch(const vector<BatchJob>& jobs, char qvalue, int number_threads) {
+    atomic<size_t> next_job(0); // Each thread takes the next job not taken yet
+    atomic<bool> success(true);
+
+    auto worker = [&]() {
+        for (size_t job = next_job++; job < jobs.size(); job = next_job++) {
+            FILE* out = fopen(jobs[job].output_name.c_str(), "w");
+            if (out == NULL) {
+                fprintf(stderr, "Could not open the output file %s\n", jobs[job].output_name.c_str());
+                success = false;
+                continue;
+            }
+            run_job(jobs[job].svalue, qvalue, *jobs[job].input_file, jobs[job].number_processes, out, jobs[job].options);
+            if (fclose(out) != 0) {
+                fprintf(stderr, "Could not write the output file %s\n", jobs[job].output_name.c_str());
+                success = false;
+            }
+        }
+    };
 
-    void simulation(Scheduler* scheduler){
+    // The main thread works too
+    vector<thread> threads;
+    for (int i = 1; i < number_threads; i++) {
+        threads.push_back(thread(worker));
+    }
+    worker();
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    return success;
+}
 
-        bool CALL_SCHEDULER; // Decide when scheduler needs to choose another process to run
-        Event* event = DES_Layer::get_event();
-        // while loop stop when event == 0 which happens at the end of the DES layer
-        while (event) {
-            Process* process = event->process;
-            CURRENT_TIME = event->timestamp;
-            State trans_to = event->new_state; // next transition state of the event
-
-            // Update the performance stats
-            if (event->old_state == RUNNING) { 
-                // By construction, process->clock is the time when the process entered the running state
-                output.cpuUtilization += (double) CURRENT_TIME - (double) process->clock; 
-            }
-            if (event->old_state == BLOCKED) { 
-                output.number_io_processes--;
-                if (output.number_io_processes == 0) {
-                    // No more processes in block state so we can compute the duration of io utilization between
-                    // last process and first process
-                    output.ioUtilization += (double) CURRENT_TIME - (double) output.start_of_IO_utilization;
-                }
-            }
-
-            // Check next state transition and do actions accordingly
-            switch (trans_to) {
-            case READY : {
-                // Add process to the runqueue
-                scheduler->add_process(process);
-
-                // Check if preempted from RUNNING state or not
-                if (process->remainingBurstTime > 0) {
-                    CURRENT_RUNNING_PROCESS = nullptr; // We stop the process from running
-                }
-                // Else the process comes from BLOCKED or CREATED. 
-                // We need to deal with the special preemption case from E scheduler
-                // CURRENT_RUNNING_PROCESS != nullptr means that it doesn't come from the first CREATED process of the program
-                else if (scheduler->preprio_flag && CURRENT_RUNNING_PROCESS != nullptr) {
-                    // This checks the dynamic priorities and if the current running process wasn't going to stop now
-                    bool isPreemption = scheduler->test_preempt(CURRENT_RUNNING_PROCESS, process, CURRENT_TIME);
-
-                    if (isPreemption) {
-                        // If preemption happens, we need to remove the obsolete RUNNING->READY or RUNNING->BLOCKED event from the running process
-                        DES_Layer::remove_event(CURRENT_RUNNING_PROCESS);
-                        // We need to add the preemption event RUNNING -> READY
-                        DES_Layer::put_event( new Event(CURRENT_TIME,
-                                                        CURRENT_RUNNING_PROCESS,
-                                                        RUNNING,
-                                                        READY));
-                        // We need to update the CURRENT_RUNNING_PROCESS attributes
-                        // Since we preempt it, we store the remaining burst time it has
-                        CURRENT_RUNNING_PROCESS->remainingBurstTime += CURRENT_RUNNING_PROCESS->stopRunningTime - CURRENT_TIME;
-                        // We need to add the lost burst time to its remamining CPU time
-                        CURRENT_RUNNING_PROCESS->remainingCPUtime += CURRENT_RUNNING_PROCESS->stopRunningTime - CURRENT_TIME;
-                        // Finally, we set its stop running time to the current time since we preempt it now
-                        CURRENT_RUNNING_PROCESS->stopRunningTime = CURRENT_TIME;
-                    }
+//-------------------- STEP 11 : Benchmark --------------------
+// The benchmark mode runs every scheduler spec on every input file, one run at a time, 
+// and reports the timings and the peak memory of each run in CSV or JSON. The outputs of the simulations are discarded
 
-                }
+// Reset the peak resident memory of the process (Linux only). Returns false if it is not possible
+bool reset_peak_memory() {
+    FILE* clear_refs = fopen("/proc/self/clear_refs", "w");
+    if (clear_refs == NULL) {
+        return false;
+    }
+    bool success = fputs("5", clear_refs) >= 0;
+    return (fclose(clear_refs) == 0) && success;
+}
 
-                CALL_SCHEDULER = true;
+// Peak resident memory in KB since the last reset (since the start of the process if the reset is not possible)
+long peak_memory_kb() {
+    FILE* status = fopen("/proc/self/status", "r");
+    if (status != NULL) {
+        char line[256];
+        long peak = -1;
+        while (fgets(line, sizeof(line), status) != NULL) {
+            if (sscanf(line, "VmHWM: %ld kB", &peak) == 1) {
                 break;
             }
+        }
+        fclose(status);
+        if (peak >= 0) {
+            return peak;
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
 
-            case RUNNING : {
+// format is "csv" or "json". rand_load_seconds is the time spent loading the rand file
+// number_processes and parse_seconds give the number of processes of each input file and the time spent checking it (once for all its runs)
+bool run_benchmark(const vector<MappedFile>& input_files, const vector<int>& number_processes, const vector<double>& parse_seconds,
+        const vector<string>& svalues, char qvalue, const RunOptions& options, const string& format, double rand_load_seconds) {
+    bool json = (format == "json");
+    FILE* discard = fopen("/dev/null", "w");
+    if (discard == NULL) {cout<< "Could not open /dev/null \n"; return false;}
+
+    if (json) {
+        printf("[\n");
+    } else {
+        printf("input,spec,engine,processes,events,rand_load_s,parse_s,simulation_s,summary_s,total_s,events_per_s,peak_rss_kb\n");
+    }
+    bool first = true;
+    for (size_t i = 0; i < input_files.size(); i++) {
+        for (size_t j = 0; j < svalues.size(); j++) {
+            RunStats stats;
+            reset_peak_memory();
+            run_job(svalues[j], qvalue, input_files[i], number_processes[i], discard, options, &stats);
+            fflush(discard);
+            long peak = peak_memory_kb();
+            double total_seconds = parse_seconds[i] + stats.simulation_seconds + stats.summary_seconds;
+            double events_per_second = stats.simulation_seconds > 0 ? stats.number_events / stats.simulation_seconds : 0;
+            const char* row_format = json ? 
+                "%s  {\"input\": \"%s\", \"spec\": \"%s\", \"engine\": \"%c\", \"processes\": %d, \"events\": %lld, \"rand_load_s\": %.6f, "
+                "\"parse_s\": %.6f, \"simulation_s\": %.6f, \"summary_s\": %.6f, \"total_s\": %.6f, \"events_per_s\": %.0f, \"peak_rss_kb\": %ld}" :
+                "%s%s,%s,%c,%d,%lld,%.6f,%.6f,%.6f,%.6f,%.6f,%.0f,%ld\n";
+            printf(row_format,
+                    json ? (first ? "" : ",\n") : "",
+                    input_files[i].path.c_str(),
+                    svalues[j].c_str(),
+                    qvalue,
+                    number_processes[i],
+                    stats.number_events,
+                    rand_load_seconds,
+                    parse_seconds[i],
+                    stats.simulation_seconds,
+                    stats.summary_seconds,
+                    total_seconds,
+                    events_per_second,
+                    peak
+                );
+            fflush(stdout);
+            first = false;
+        }
+    }
+    if (json) {
+        printf("\n]\n");
+    }
+    fclose(discard);
+    return true;
+}
 
-                // Update CPU waiting time to compute average performance later
-                // process->clock is the time the process was added in READY state
-                process->cpuWaitingTime += CURRENT_TIME - process->clock;
+//-------------------- STEP 12 : Regression test --------------------
+// The test mode runs every (input file, scheduler spec) pair in memory and compares each output
+// byte for byte with the reference output of runit.sh (the output_name of the job). It prints one line per case
+// with its time, and the first line that differs for a mismatch
 
-                int cpu_burst_duration;
-                bool TO_BE_PREEMPTED;
+// Line of text that starts at offset (without the '\n')
+string line_at(const char* data, size_t size, size_t offset) {
+    size_t end = offset;
+    while (end < size && data[end] != '\n') {
+        end++;
+    }
+    return string(data + offset, end - offset);
+}
 
-                // 4 CASES of cpu burst duration:
-                // CASE 1 : Process was preempted and the remaining cpu burst time is HIGHER than the quantum
-                //      => We give a quantum burst time and we reduce the remaining cpu burst time
-                if (process->remainingBurstTime > 0 && process->remainingBurstTime > scheduler->quantum) {
-                    cpu_burst_duration = scheduler->quantum;
-                    process->remainingBurstTime -= scheduler->quantum;
-                    TO_BE_PREEMPTED = true;
-                }
-                // CASE 2 : Process was preempted and the remaining cpu burst time is LOWER than the quantum
-                //      => We give the remaining cpu burst time
-                else if (process->remainingBurstTime > 0 && process->remainingBurstTime <= scheduler->quantum) {
-                    cpu_burst_duration = process->remainingBurstTime;
-                    process->remainingBurstTime = 0;
-                    TO_BE_PREEMPTED = false;
-                }
-                // CASE 3 AND 4 : Process was not preempted so we compute a new random cpu burst duration
-                else {
-                    cpu_burst_duration = get_random_number(process->cpuBurst);
-                    // CASE 3 : random cpu burst duration is HIGHER than quantum
-                    //      => We give a quantum burst duration and we mark the process to be preempted
-                    if (cpu_burst_duration > scheduler->quantum) {
-                        process->remainingBurstTime = cpu_burst_duration - scheduler->quantum;
-                        cpu_burst_duration = scheduler->quantum;
-                        TO_BE_PREEMPTED = true;
-                    }
-                    // CASE 4 : random cpu burst duration is LOWER than quantum
-                    //      => We don't do anything
-                    else {
-                        TO_BE_PREEMPTED = false;
-                    }
-                }
+// Print the first line that differs between the reference and the output
+void print_first_difference(const char* expected, size_t expected_size, const char* output, size_t output_size) {
+    size_t offset = 0;
+    int line_number = 1;
+    size_t line_start = 0;
+    while (offset < expected_size && offset < output_size && expected[offset] == output[offset]) {
+        if (expected[offset] == '\n') {
+            line_number++;
+            line_start = offset + 1;
+        }
+        offset++;
+    }
+    printf("    line %d\n", line_number);
+    printf("    expected: %s\n", line_start < expected_size ? line_at(expected, expected_size, line_start).c_str() : "<end of file>");
+    printf("    got:      %s\n", line_start < output_size ? line_at(output, output_size, line_start).c_str() : "<end of file>");
+}
 
-                // Now we check if it's going to be blocked, preempted or if it's going to be done
-                //// Check if the job will be done
-                if (process->remainingCPUtime <= cpu_burst_duration) {
-                    cpu_burst_duration = process->remainingCPUtime;
-                    DES_Layer::put_event( new Event(CURRENT_TIME+cpu_burst_duration, 
-                                                    process,
-                                                    RUNNING,
-                                                    DONE));
-                    //// We reset the remaining burst time and cpu time since the job will be done
-                    process->remainingBurstTime = 0;
-                    process->remainingCPUtime = 0;
-                }
-                //// Check if the job will be preempted
-                else if (TO_BE_PREEMPTED) {
-                    // Create preemption event RUNNING -> READY
-                    DES_Layer::put_event( new Event(CURRENT_TIME + cpu_burst_duration,
-                                                    process,
-                                                    RUNNING,
-                                                    READY));
-                    process->remainingCPUtime -= cpu_burst_duration;
-                }
-                //// If not preempted or done, it means it's gonna be blocked
-                else {
-                    // Create block event RUNNING -> BLOCKED
-                    DES_Layer::put_event( new Event(CURRENT_TIME + cpu_burst_duration, 
-                                                    process,
-                                                    RUNNING,
-                                                    BLOCKED));
-                    process->remainingCPUtime -= cpu_burst_duration;
-                }
+// Returns false if any output differs from its reference (or a reference is missing)
+bool run_regression(const vector<BatchJob>& jobs, char qvalue) {
+    int number_failed = 0;
+    double total_seconds = 0;
+    for (size_t job = 0; job < jobs.size(); job++) {
+        const string& reference_name = jobs[job].output_name;
+        string case_name = reference_name.substr(reference_name.find_last_of('/') + 1);
+
+        // The output is written in a memory buffer
+        char* output = NULL;
+        size_t output_size = 0;
+        FILE* out = open_memstream(&output, &output_size);
+        if (out == NULL) {cout<< "Could not create the output buffer \n"; return false;}
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        run_job(jobs[job].svalue, qvalue, *jobs[job].input_file, jobs[job].number_processes, out, jobs[job].options);
+        fclose(out);
+        double seconds = seconds_since(start);
+        total_seconds += seconds;
+
+        MappedFile reference;
+        if (!reference.open(reference_name.c_str())) {
+            printf("FAIL %-12s %10.6f s  missing reference %s\n", case_name.c_str(), seconds, reference_name.c_str());
+            number_failed++;
+        }
+        else if (reference.size != output_size || memcmp(reference.data, output, output_size) != 0) {
+            printf("FAIL %-12s %10.6f s  output differs from %s\n", case_name.c_str(), seconds, reference_name.c_str());
+            print_first_difference(reference.data, reference.size, output, output_size);
+            number_failed++;
+        }
+        else {
+            printf("ok   %-12s %10.6f s\n", case_name.c_str(), seconds);
+        }
+        free(output);
+    }
+    printf("%d/%d passed in %.6f s (engine %c)\n", (int) jobs.size() - number_failed, (int) jobs.size(), total_seconds, qvalue);
+    return number_failed == 0;
+}
 
-                // Finally, we store the time when the process will stop running
-                // We need to store this value to check if the E scheduler will preempt the process with a new READY process
-                process->stopRunningTime = CURRENT_TIME + cpu_burst_duration;
-                break;
-            }
-            
-            case BLOCKED : {
-                CURRENT_RUNNING_PROCESS = nullptr; // We stop the process from running
-                // Increment number of processes in BLOCKED state. Used to compute the average IO utilization
-                output.number_io_processes += 1; 
-                // If it's the first process that uses IO, we record the start time. Used to compute the average IO utilization
-                if (output.number_io_processes == 1) {
-                    output.start_of_IO_utilization = CURRENT_TIME;
-                }
-                // Compute random io burst time
-                int io_burst_duration = get_random_number(process->ioBurst);
-
-                // update IO waiting time
-                process->ioWaitingTime += io_burst_duration;
-
-                // Create BLOCKED -> RDY event
-                DES_Layer::put_event( new Event(CURRENT_TIME+io_burst_duration, 
-                                    process,
-                                    BLOCKED,
-                                    READY));
-                // Call scheduler for next running process
-                CALL_SCHEDULER = true;
 
-                break;
+//-------------------- STEP 13 : Parallel simulation of CPU partitions --------------------
+// -P K splits the -c cores in K partitions and pins the process pid to the partition pid % K.
+// Each partition is a whole simulation on its own thread : its own DES layer, run queues, random stream (starting at its own offset)
+// and its own reader of the input file, which only creates the processes of the partition.
+// A partition never puts or cancels an event of another partition. The only state they would share in a single simulation
+// is the number of processes in IO, which only feeds the IO utilization. So the lookahead of a partition is unbounded and
+// the conservative synchronization never has to block an event for correctness.
+// The partitions still advance in time windows of at least PARTITION_WINDOW time units, so the output stays streamed :
+// a partition stops before its first event after the window and the last partition to stop ends the window.
+// It merges the IO busy intervals of the window (the IO utilization is their union over the partitions)
+// and prints the summary lines that are ready, in pid order. The next window starts at the earliest next event of the partitions
+const int PARTITION_WINDOW = 4096;
+
+class PartitionWindow {
+    public:
+        int horizon = PARTITION_WINDOW; // The partitions process the events before horizon
+
+        // Called by a partition stopped at its next event next_time (>= horizon, INT_MAX if it has no event left)
+        // Returns when the window is over, true if every partition is done
+        bool wait(int partition, int next_time) {
+            unique_lock<mutex> guard(lock);
+            next_times[partition] = next_time;
+            waiting++;
+            if (waiting == (int) partitions.size()) {
+                end_window();
+                waiting = 0;
+                generation++;
+                window_over.notify_all();
+            } else {
+                long long window = generation;
+                window_over.wait(guard, [&]() { return generation != window; });
             }
+            return finished;
+        }
 
-            case DONE : {
-                CURRENT_RUNNING_PROCESS = nullptr; // We stop the process form running
-                process->finishingTime = CURRENT_TIME;
-                process->turnaroundTime = CURRENT_TIME - process->arrivalTime;
-                CALL_SCHEDULER = true; // Call scheduler for next running process
-                break;
+        // Called by a partition when its simulation is over
+        void finish(int partition) {
+            while (!wait(partition, INT_MAX)) {}
+        }
+
+        // merged prints the summary of every partition
+        PartitionWindow(vector<Simulator*>& partitions_, Simulator& merged_):partitions(partitions_), merged(merged_) {
+            next_times.assign(partitions.size(), 0);
+        }
+
+    private:
+        mutex lock;
+        condition_variable window_over;
+        int waiting = 0; // Partitions stopped at the end of the window
+        long long generation = 0; // Number of windows over
+        bool finished = false;
+        vector<int> next_times; // Next event of each partition
+        vector<Simulator*>& partitions;
+        Simulator& merged;
+        int next_pid = 0; // Next summary line to print
+
+        // Every partition is stopped
+        void end_window() {
+            int next_time = *min_element(next_times.begin(), next_times.end());
+            finished = (next_time == INT_MAX);
+            int window_end = horizon;
+            if (finished) {
+                // The last window ends with the last event
+                for (size_t partition = 0; partition < partitions.size(); partition++) {
+                    window_end = max(window_end, partitions[partition]->CURRENT_TIME);
+                }
             }
-            case CREATED : {
-                cout << "hello, i'm here bcs I get a warning if i don't include CREATED in the switch statement" << endl;
+            merge_io_intervals(window_end);
+            release_processes();
+            if (!finished) {
+                horizon = next_time + PARTITION_WINDOW;
             }
+        }
 
+        // IO utilization : length of the union of the IO busy intervals of the partitions in the window
+        void merge_io_intervals(int window_end) {
+            vector<IOInterval> intervals;
+            for (size_t partition = 0; partition < partitions.size(); partition++) {
+                Simulator* simulator = partitions[partition];
+                // An interval still open goes up to the end of the window and goes on in the next one
+                if (simulator->output.number_io_processes > 0) {
+                    simulator->io_intervals.push_back(IOInterval{simulator->output.start_of_IO_utilization, window_end});
+                    simulator->output.start_of_IO_utilization = window_end;
+                }
+                intervals.insert(intervals.end(), simulator->io_intervals.begin(), simulator->io_intervals.end());
+                simulator->io_intervals.clear();
             }
-
-            process->clock = CURRENT_TIME; // update clock of process
-
-            if (CALL_SCHEDULER) {
-                // process the same time occuring events in order of appearance
-                if (DES_Layer::get_next_time_event() == CURRENT_TIME) { 
-                    event = DES_Layer::get_event(); 
-                    continue;
-                } 
-                // reset flag
-                CALL_SCHEDULER = false;
-                // Check if we need to fidn a new running process
-                if (CURRENT_RUNNING_PROCESS == nullptr) {
-                    CURRENT_RUNNING_PROCESS = scheduler->get_next_process();
-                    // If ready queue is empty, we get next event 
-                    // (!!! =/= end of simulation : maybe next event is CREATED->READY and we'll get a new running process !!!)
-                    if (CURRENT_RUNNING_PROCESS == nullptr) { 
-                        // If event is null then it's really the end of simulation
-                        event = DES_Layer::get_event(); 
-                        continue; // go to next while iteration
+            sort(intervals.begin(), intervals.end(), [](const IOInterval& a, const IOInterval& b) { return a.start < b.start; });
+            int union_start = 0;
+            int union_end = -1; // Current interval of the union (none yet)
+            for (size_t i = 0; i < intervals.size(); i++) {
+                if (intervals[i].start > union_end) {
+                    if (union_end > union_start) {
+                        merged.output.ioUtilization += (double) union_end - (double) union_start;
                     }
-                    // put the ready->running event for current time
-                    DES_Layer::put_event( new Event(CURRENT_TIME, CURRENT_RUNNING_PROCESS, READY, RUNNING) );
+                    union_start = intervals[i].start;
+                    union_end = intervals[i].end;
+                } else {
+                    union_end = max(union_end, intervals[i].end);
                 }
             }
-            // get next event
-            event = DES_Layer::get_event(); 
-
-        } // end of while (event) loop
-
-
-    }; // end of simulation function
-
-    //-------------------- STEP 9 : Print Summary --------------------
+            if (union_end > union_start) {
+                merged.output.ioUtilization += (double) union_end - (double) union_start;
+            }
+        }
 
-    void print_summary() {
+        // Print the summary lines in pid order as long as the next one is done
+        // At the end, the processes never done are printed too
+        void release_processes() {
+            int number_partitions = partitions.size();
+            if (finished) {
+                for (int partition = 0; partition < number_partitions; partition++) {
+                    queue<Process*>& processes = partitions[partition]->processes;
+                    while (!processes.empty()) {
+                        partitions[partition]->released.push(processes.front());
+                        processes.pop();
+                    }
+                }
+            }
+            while (true) {
+                Simulator* simulator = partitions[next_pid % number_partitions];
+                if (simulator->released.empty() || simulator->released.front()->pid != next_pid) {
+                    break;
+                }
+                merged.format_process(simulator->released.front());
+                simulator->printed.push_back(simulator->released.front());
+                simulator->released.pop();
+                next_pid++;
+            }
+        }
+};
 
-        // total number of processes (used to compute the averages)
-        double number_of_processes = processes.size();
+void Simulator::wait_for_window(int next_time) {
+    while (next_time >= window->horizon) {
+        window->wait(partition, next_time);
+    }
+    // The processes printed at the end of the window go back to the pool of this thread
+    for (size_t i = 0; i < printed.size(); i++) {
+        delete printed[i];
+    }
+    printed.clear();
+}
 
-        while (!processes.empty()) {
-            Process* process = processes.front();
-            output.avgTurnaroundTime += (double) process->turnaroundTime; // to compute average later
-            output.avgCPUWaitingTime += (double) process->cpuWaitingTime; // to comput average later
-            printf("%04d: %4d %4d %4d %4d %1d | %5d %5d %5d %5d\n", 
-                    process->pid,
-                    process->arrivalTime,
-                    process->totalCPUTime,
-                    process->cpuBurst,
-                    process->ioBurst,
-                    process->static_prio,
-                    process->finishingTime,
-                    process->turnaroundTime,
-                    process->ioWaitingTime,
-                    process->cpuWaitingTime
-                );
-                processes.pop();
+// Simulate the processes of input_file on number_cores cores split in number_partitions partitions, each on its own thread
+// The random numbers must be loaded, svalue and qvalue must be valid, number_partitions <= number_cores
+// and input_file must have been checked by check_input_file (number_processes is its number of processes)
+void run_partitions(const string& svalue, char qvalue, const MappedFile& input_file, int number_processes, FILE* out, int number_cores, int number_partitions,
+        RunStats* stats) {
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Simulator merged(create_event_queue(qvalue), out); // Only prints the summary
+    vector<Simulator*> partitions(number_partitions);
+    vector<vector<Scheduler*>> cores(number_partitions);
+    vector<ProcessReader*> readers(number_partitions);
+    PartitionWindow window(partitions, merged);
+    for (int partition = 0; partition < number_partitions; partition++) {
+        // The first partitions get one more core if the cores can't be split evenly
+        int partition_cores = number_cores / number_partitions + (partition < number_cores % number_partitions ? 1 : 0);
+        for (int core = 0; core < partition_cores; core++) {
+            cores[partition].push_back(create_scheduler(svalue));
         }
+        Simulator* simulator = new Simulator(create_event_queue(qvalue), out);
+        simulator->window = &window;
+        simulator->partition = partition;
+        readers[partition] = new ProcessReader(input_file, cores[partition][0], simulator->processes);
+        readers[partition]->partition = partition;
+        readers[partition]->number_partitions = number_partitions;
+        simulator->arrivals = readers[partition];
+        simulator->random.ofs = (number_processes + (long long) partition * (total_random_num / number_partitions)) % total_random_num;
+        partitions[partition] = simulator;
+    }
 
-        // Compute average turn around time and average cpu waiting time
-        output.avgTurnaroundTime /= number_of_processes;
-        output.avgCPUWaitingTime /= number_of_processes;
+    cores[0][0]->print_scheduler(out);
 
-        // By construciton, the finishing time of last event is stored in the CURRENT_TIME of last while loop iteration
-        output.finishingTimeOfLastEvent = CURRENT_TIME;
+    // What the SUM line needs from each partition, saved before the partition is deleted
+    struct PartitionSummary {
+        int end_time;
+        double cpu_utilization;
+        int number_cores;
+        vector<double> core_busy_time;
+        long long number_events;
+    };
+    vector<PartitionSummary> summaries(number_partitions);
+    auto run_partition = [&](int partition) {
+        NoStats no_stats;
+        Simulator* simulator = partitions[partition];
+        dispatch_simulation(*simulator, svalue, cores[partition], no_stats);
+        window.finish(partition);
+        // Every summary line is printed once finish returns. The objects of the partition are released here
+        // because their memory comes from the pools of this thread (see STEP 0)
+        summaries[partition] = PartitionSummary{simulator->CURRENT_TIME, simulator->output.cpuUtilization, simulator->number_cores, simulator->core_busy_time, simulator->number_events};
+        for (size_t i = 0; i < simulator->printed.size(); i++) {
+            delete simulator->printed[i];
+        }
+        delete readers[partition];
+        delete simulator;
+        for (size_t core = 0; core < cores[partition].size(); core++) {
+            delete cores[partition][core];
+        }
+    };
+    // The main thread runs the first partition
+    vector<thread> threads;
+    for (int partition = 1; partition < number_partitions; partition++) {
+        threads.push_back(thread(run_partition, partition));
+    }
+    run_partition(0);
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
 
-        // Compute the CPU and IO utlization ratio
-        output.cpuUtilization = 100 * output.cpuUtilization / (double) output.finishingTimeOfLastEvent;
-        output.ioUtilization = 100 * output.ioUtilization / (double) output.finishingTimeOfLastEvent;
-        
-        // Compute the throughput per 100 time units
-        output.throughputPer100TimeUnits = 100 * number_of_processes / (double) output.finishingTimeOfLastEvent;
+    if (stats != nullptr) {
+        stats->simulation_seconds = seconds_since(start);
+        stats->number_events = 0;
+        for (int partition = 0; partition < number_partitions; partition++) {
+            stats->number_events += summaries[partition].number_events;
+        }
+        start = chrono::steady_clock::now();
+    }
 
+    // Merge the stats of the partitions and print the SUM line
+    merged.number_cores = 0;
+    merged.core_busy_time.clear();
+    for (int partition = 0; partition < number_partitions; partition++) {
+        PartitionSummary& summary = summaries[partition];
+        merged.CURRENT_TIME = max(merged.CURRENT_TIME, summary.end_time);
+        merged.output.cpuUtilization += summary.cpu_utilization;
+        merged.number_cores += summary.number_cores;
+        merged.core_busy_time.insert(merged.core_busy_time.end(), summary.core_busy_time.begin(), summary.core_busy_time.end());
+    }
+    merged.print_summary();
 
-        // Print summary
-        printf("SUM: %d %.2lf %.2lf %.2lf %.2lf %.3lf\n",
-                output.finishingTimeOfLastEvent,
-                output.cpuUtilization,
-                output.ioUtilization,
-                output.avgTurnaroundTime,
-                output.avgCPUWaitingTime,
-                output.throughputPer100TimeUnits
-            );
+    if (stats != nullptr) {
+        stats->summary_seconds = seconds_since(start);
+    }
+}
 
-    } // end of print_summary function
 
-}; // End of simulator struct
+// Name of the output of a batch run, in the same format as runit.sh : <outdir>/out_<n>_<spec> 
+// where inputs/input<n> gives <n> and the ':' of the spec become '_'. The RunOptions name follows (for example _c4 with -c 4)
+string batch_output_name(const string& outdir, const string& input_path, string svalue) {
+    string input_name = input_path.substr(input_path.find_last_of('/') + 1);
+    if (input_name.compare(0, 5, "input") == 0 && input_name.size() > 5) {
+        input_name = input_name.substr(5);
+    }
+    for (size_t i = 0; i < svalue.size(); i++) {
+        if (svalue[i] == ':') {
+            svalue[i] = '_';
+        }
+    }
+    return outdir + "/out_" + input_name + "_" + svalue;
+}
 
+// Parse a positive number option (-c, -P, -j). Returns false if arg is not a whole number between 1 and INT_MAX
+bool parse_positive(const char* arg, int& value) {
+    char* end = nullptr;
+    errno = 0;
+    long number = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno == ERANGE || number < 1 || number > INT_MAX) {
+        return false;
+    }
+    value = (int) number;
+    return true;
+}
 
 
 int main(int argc, char *argv[]) {
-    int sflag = 0;
-    char *svalue = NULL;
+    vector<string> svalues; // Every -s spec. Batch mode accepts several of them
+    char *qvalue = NULL;
+    char *ovalue = NULL; // Output directory of the batch mode
+    int number_threads = 1; // Number of threads of the batch mode
+    char *bvalue = NULL; // Output format of the benchmark mode (csv or json)
+    char *tvalue = NULL; // Reference directory of the test mode
+    int Sflag = 0; // Print the counters of the simulation loop on stderr
+    int vflag = 0; // Trace the state transitions on stderr
+    int tflag = 0; // Trace the choices of the scheduler on stderr
+    int eflag = 0; // Trace the DES layer on stderr
+    int pflag = 0; // Trace the E preemption tests on stderr
+    int Lflag = 0; // Print the latency percentiles after the SUM line
+    int number_cores = 1; // Number of simulated cores
+    int number_partitions = 0; // Number of partitions of the parallel mode (0 : no parallel mode)
+    char *ivalue = NULL; // IO devices
     int index;
     int o;
 
-    Simulator simulator; // Our simulator
-
     opterr = 0;
-    while ((o = getopt (argc, argv, "vteps:")) != -1) {
+    while ((o = getopt (argc, argv, "vtepSLs:q:o:j:B:T:c:P:i:")) != -1) {
         switch (o)
         {
         case 'v':
+            vflag = 1;
             break;
         case 't':
+            tflag = 1;
             break;
         case 'e':
+            eflag = 1;
             break;
         case 'p':
+            pflag = 1;
+            break;
+        case 'S':
+            Sflag = 1;
+            break;
+        case 'L':
+            Lflag = 1;
             break;
         case 's':
-            sflag = 1;
-            svalue = optarg;
+            svalues.push_back(optarg);
+            break;
+        case 'q':
+            qvalue = optarg;
+            break;
+        case 'o':
+            ovalue = optarg;
+            break;
+        case 'B':
+            bvalue = optarg;
+            if (string(bvalue) != "csv" && string(bvalue) != "json") {
+                fprintf (stderr, "Option -B requires csv or json.\n");
+                return 1;
+            }
+            break;
+        case 'T':
+            tvalue = optarg;
+            break;
+        case 'c':
+            if (!parse_positive(optarg, number_cores)) {
+                fprintf (stderr, "Option -c requires a positive number of cores.\n");
+                return 1;
+            }
+            break;
+        case 'i':
+            ivalue = optarg;
+            break;
+        case 'P':
+            if (!parse_positive(optarg, number_partitions)) {
+                fprintf (stderr, "Option -P requires a positive number of partitions.\n");
+                return 1;
+            }
+            break;
+        case 'j':
+            if (!parse_positive(optarg, number_threads)) {
+                fprintf (stderr, "Option -j requires a positive number of threads.\n");
+                return 1;
+            }
             break;
         case '?':
             if (optopt == 's') {
                 fprintf (stderr, "Option -%c requires a scheduler argument.\n", optopt);
             }
+            else if (optopt == 'q') {
+                fprintf (stderr, "Option -%c requires an event queue argument.\n", optopt);
+            }
+            else if (optopt == 'o') {
+                fprintf (stderr, "Option -%c requires an output directory argument.\n", optopt);
+            }
+            else if (optopt == 'B') {
+                fprintf (stderr, "Option -%c requires an output format argument (csv or json).\n", optopt);
+            }
+            else if (optopt == 'T') {
+                fprintf (stderr, "Option -%c requires a reference directory argument.\n", optopt);
+            }
+            else if (optopt == 'c') {
+                fprintf (stderr, "Option -%c requires a number of cores argument.\n", optopt);
+            }
+            else if (optopt == 'i') {
+                fprintf (stderr, "Option -%c requires an IO devices argument.\n", optopt);
+            }
+            else if (optopt == 'P') {
+                fprintf (stderr, "Option -%c requires a number of partitions argument.\n", optopt);
+            }
+            else if (optopt == 'j') {
+                fprintf (stderr, "Option -%c requires a number of threads argument.\n", optopt);
+            }
             else if (isprint (optopt)) {
                 fprintf (stderr, "Unknown option '-%c'.\n", optopt);
             }
@@ -860,95 +3809,134 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    if (sflag != 1) { printf("You must indicate the Scheduler\n"); return -1; }
-
-    Scheduler* scheduler;
-    switch (string(svalue)[0]) {
-        case 'F' : {
-            scheduler = new FCFS();
-            break;
-        }
-        case 'L' : {
-            scheduler = new LCFS();
-            break;
-        }
-        case 'S' : {
-            scheduler = new SRTF();
-            break;
-        }
-        case 'R' : {
-            int quantum = -1;
-            sscanf(string(svalue).c_str(), "R%d", &quantum);
-            if (quantum == -1) {
-                cout << "You must give a quantum for Round Robin scheduler" << endl;
-                return -1;
-            }            
-            scheduler = new RR(quantum);
-            break;
-        }
-        case 'P' : {
-            int quantum = -1;
-            int maxprio = 4;
-            if (string(svalue).find(':') != string::npos){ 
-                sscanf(string(svalue).c_str(), "P%d:%d", &quantum, &maxprio); 
-            }
-            else { 
-                sscanf(string(svalue).c_str(), "P%d", &quantum); 
-            }
+    // The benchmark and test modes run the schedulers of runit.sh by default
+    if (svalues.empty() && (bvalue != NULL || tvalue != NULL)) {
+        const char* default_svalues[] = {"F", "L", "S", "R2", "R5", "P2", "P5:3", "E2:5", "E4"};
+        svalues.assign(default_svalues, default_svalues + 9);
+    }
+    bool multiple_runs = (ovalue != NULL || bvalue != NULL || tvalue != NULL); // Several input files and specs are allowed
 
-            if (quantum == -1) {
-                cout << "You must give a quantum for PRIO scheduler" << endl;
-                return -1;
-            }
-            scheduler = new PRIO(quantum, maxprio);
-            break;
-        }
-        case 'E' : {
-            int quantum = -1;
-            int maxprio = 4;
-            if (string(svalue).find(':') != string::npos){ 
-                sscanf(string(svalue).c_str(), "E%d:%d", &quantum, &maxprio); 
-            }
-            else { 
-                sscanf(string(svalue).c_str(), "E%d", &quantum); 
-            }
+    if (svalues.empty()) { printf("You must indicate the Scheduler\n"); return -1; }
+    // Without batch mode, the last -s wins
+    if (!multiple_runs) { svalues.erase(svalues.begin(), svalues.end() - 1); }
 
-            if (quantum == -1) {
-                cout << "You must give a quantum for PREPRIO scheduler" << endl;
-                return -1;
-            }
-            scheduler = new PREPRIO(quantum, maxprio);
-            break;
-        }
-        default : {
-            cout << "Scheduler doesn't exist. Choose between F,L,S,RR,P and E" << endl;
+    // Check every scheduler spec before running anything
+    for (size_t i = 0; i < svalues.size(); i++) {
+        Scheduler* scheduler = create_scheduler(svalues[i]);
+        if (scheduler == nullptr) {
             return -1;
-            break;
         }
+        delete scheduler;
     }
 
+    // Check the event queue engine of the DES layer (heap by default)
+    char engine = (qvalue == NULL ? 'H' : qvalue[0]);
+    EventQueue* event_queue = create_event_queue(engine);
+    if (event_queue == nullptr) {
+        return -1;
+    }
+    delete event_queue;
 
-    if (argc - optind < 2 ) { printf("Please give an input file AND a random file\n"); return -1; }
-    else if (argc - optind > 2) { printf("Please put only 1 input file and only 1 random file\n"); return -1; }
-    // Now we know we have an input file and a random file as non-option arguments
-    ifstream input_file ( argv[optind] ); // input file
-    ifstream rand_file ( argv[optind + 1] ); // rand file
+    // The partitions only print the summary lines and the SUM line
+    if (number_partitions > 0) {
+        if (number_partitions > number_cores) { printf("Every partition needs at least one core : use -c with at least %d cores\n", number_partitions); return -1; }
+        if (Sflag || Lflag || vflag || tflag || eflag || pflag) { printf("The counters (-S), the latencies (-L) and the traces (-v -t -e -p) can only be used without -P\n"); return -1; }
+    }
+    // The batch, benchmark and test modes only write the outputs of the runs
+    if (multiple_runs && (Sflag || Lflag || vflag || tflag || eflag || pflag)) {
+        printf("The counters (-S), the latencies (-L) and the traces (-v -t -e -p) can only be used for a single run\n"); return -1;
+    }
 
-    // Check if file opening succeeded
-    if ( !input_file.is_open() ) {cout<< "Could not open the input file \n"; return -1;}
-    else if ( !rand_file.is_open() ) {cout<< "Could not open the rand file \n"; return -1;}
+    // Build the IO devices (-i) : only without partitions
+    IOSubsystem* io = nullptr;
+    if (ivalue != NULL) {
+        if (number_partitions > 0) { printf("The IO devices (-i) can only be used without -P\n"); return -1; }
+        io = create_io_subsystem(ivalue);
+        if (io == nullptr) {
+            return -1;
+        }
+    }
 
-    // Create random numbers array
-    initialize_random_array(rand_file);
+    if (argc - optind < 2 ) { printf("Please give an input file AND a random file\n"); return -1; }
+    else if (!multiple_runs && argc - optind > 2) { printf("Please put only 1 input file and only 1 random file\n"); return -1; }
+    // Now we know we have input files and a random file (the last one) as non-option arguments
+    MappedFile rand_file; // rand file
+    if (!multiple_runs) {
+        MappedFile input_file; // input file
+        // Check if file opening succeeded
+        if ( !input_file.open(argv[optind]) ) {cout<< "Could not open the input file \n"; return -1;}
+        else if ( !rand_file.open(argv[argc - 1]) ) {cout<< "Could not open the rand file \n"; return -1;}
+
+        // Create random numbers array
+        if (!initialize_random_array(rand_file)) { return -1; }
+        int number_processes;
+        if (!check_input_file(input_file, number_processes)) { return -1; }
+
+        if (number_partitions > 0) {
+            run_partitions(svalues[0], engine, input_file, number_processes, stdout, number_cores, number_partitions);
+            return 0;
+        }
 
-    // Create the processes queue and the first CREATE events in the DES layer
-    createProcesses(input_file, scheduler);
+        // The trace goes to stderr so stdout stays the same as without tracing
+        TraceBuffer* trace = nullptr;
+        if (vflag || tflag || eflag || pflag) {
+            trace = new TraceBuffer(stderr, vflag, tflag, eflag, pflag);
+        }
+        SimulationStats counters;
+        LatencyReport* latency = Lflag ? new LatencyReport() : nullptr;
+        run_simulation(svalues[0], engine, input_file, number_processes, stdout, nullptr, Sflag ? &counters : nullptr, trace, latency, number_cores, io);
+        delete trace;
+        delete latency;
+        delete io;
+        if (Sflag) {
+            fflush(stdout);
+            counters.print(stderr);
+        }
+        return 0;
+    }
 
-    // Start the simulation
-    simulator.simulation(scheduler);
+    // Batch mode : one output file per (input file, scheduler spec) pair
+    // Test mode : one reference file per pair, named like the output files of the batch mode
+    // Every input file is mapped and checked once and the random numbers are loaded once for every run
+    const char* job_directory = (tvalue != NULL ? tvalue : ovalue);
+    RunOptions options;
+    options.number_cores = number_cores;
+    options.number_partitions = number_partitions;
+    if (io != nullptr) {
+        options.ivalue = ivalue;
+        delete io; // Each run builds its own devices
+    }
+    vector<MappedFile> input_files(argc - 1 - optind);
+    vector<int> number_processes(input_files.size());
+    vector<double> parse_seconds(input_files.size());
+    vector<BatchJob> jobs;
+    for (index = optind; index < argc - 1; index++) {
+        MappedFile& input_file = input_files[index - optind];
+        if ( !input_file.open(argv[index]) ) {cout<< "Could not open the input file " << argv[index] << "\n"; return -1;}
+        chrono::steady_clock::time_point parse_start = chrono::steady_clock::now();
+        if (!check_input_file(input_file, number_processes[index - optind])) { return -1; }
+        parse_seconds[index - optind] = seconds_since(parse_start);
+        for (size_t i = 0; i < svalues.size() && job_directory != NULL; i++) {
+            BatchJob job;
+            job.input_file = &input_file;
+            job.number_processes = number_processes[index - optind];
+            job.svalue = svalues[i];
+            job.options = options;
+            job.output_name = batch_output_name(job_directory, argv[index], svalues[i]) + options.name();
+            jobs.push_back(job);
+        }
+    }
+    chrono::steady_clock::time_point rand_load_start = chrono::steady_clock::now();
+    if ( !rand_file.open(argv[argc - 1]) ) {cout<< "Could not open the rand file \n"; return -1;}
+    if (!initialize_random_array(rand_file)) { return -1; }
+    double rand_load_seconds = seconds_since(rand_load_start);
 
-    // Print the summary
-    scheduler->print_scheduler(); // print scheduler name (and quantum)
-    simulator.print_summary(); // print the summary
+    if (bvalue != NULL) {
+        return run_benchmark(input_files, number_processes, parse_seconds, svalues, engine, options, bvalue, rand_load_seconds) ? 0 : -1;
+    }
+    if (tvalue != NULL) {
+        return run_regression(jobs, engine) ? 0 : -1;
+    }
+    return run_batch(jobs, engine, number_threads) ? 0 : -1;
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,190 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+// Reading and writing of the workload files (input files) and random tables (rand files)
+// Shared by sched and the tools (schedconv)
+//
+// Text formats :
+//   input file : one process per line "AT TC CB IO"
+//   rand file  : the number of random numbers on the first line, then one random number per line
+//
+// Binary format (version 1) : a 16 bytes header followed by fixed-width records. Every integer is a little-endian int32
+//   header     : magic (4 chars) | version (int32) | number of records (int64)
+//   input file : magic "SCHW", one record of 4 int32 (AT TC CB IO) per process
+//   rand file  : magic "SCHR", one record of 1 int32 per random number
+// The records are read in place from the mapped file (zero copy)
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <string>
+
+// Whole file mapped in memory (read only). In batch mode one mapping is shared by every simulation of the file
+struct MappedFile {
+    std::string path;
+    const char* data = nullptr;
+    size_t size = 0;
+
+    bool open(const char* path_) {
+        path = path_;
+        int fd = ::open(path_, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) < 0) {
+            close(fd);
+            return false;
+        }
+        size = file_stat.st_size;
+        // mmap refuses empty mappings, an empty file just has no data
+        if (size > 0) {
+            void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr == MAP_FAILED) {
+                close(fd);
+                return false;
+            }
+            madvise(ptr, size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(ptr);
+        }
+        close(fd);
+        return true;
+    }
+
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (data != nullptr) {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+};
+
+// Reads the non-negative integers of a mapped file line by line
+struct LineTokenizer {
+    const char* cur;
+    const char* end;
+    int line_number = 0; // Line of the last line read (starting at 1)
+
+    LineTokenizer(const MappedFile& file) {
+        cur = file.data;
+        end = file.data + file.size;
+    }
+
+    // Read the integers of the next line in values.
+    // Returns the number of integers of the line, -1 at the end of the file,
+    // -2 if the line has something else than integers or more than max_values integers
+    int next_line(int* values, int max_values) {
+        if (cur == end) {
+            return -1;
+        }
+        line_number++;
+        int count = 0;
+        while (cur != end && *cur != '\n') {
+            char c = *cur;
+            if (c == ' ' || c == '\t' || c == '\r') {
+                cur++;
+            }
+            else if (c >= '0' && c <= '9') {
+                long long value = 0;
+                while (cur != end && *cur >= '0' && *cur <= '9') {
+                    value = 10 * value + (*cur - '0');
+                    if (value > INT_MAX) {
+                        return skip_line();
+                    }
+                    cur++;
+                }
+                // A number must end with a blank or the end of the line
+                if (cur != end && *cur != ' ' && *cur != '\t' && *cur != '\r' && *cur != '\n') {
+                    return skip_line();
+                }
+                if (count == max_values) {
+                    return skip_line();
+                }
+                values[count++] = value;
+            }
+            else {
+                return skip_line();
+            }
+        }
+        if (cur != end) {
+            cur++; // skip '\n'
+        }
+        return count;
+    }
+
+    private:
+        int skip_line() {
+            while (cur != end && *cur != '\n') {
+                cur++;
+            }
+            if (cur != end) {
+                cur++;
+            }
+            return -2;
+        }
+};
+
+const char WORKLOAD_MAGIC[4] = {'S', 'C', 'H', 'W'};
+const char RANDOM_MAGIC[4] = {'S', 'C', 'H', 'R'};
+const int32_t BINARY_VERSION = 1;
+
+struct BinaryHeader {
+    char magic[4];
+    int32_t version;
+    int64_t number_records;
+};
+
+// The records are used in place so the host must be little-endian like the files
+inline bool is_little_endian() {
+    const uint16_t one = 1;
+    return *reinterpret_cast<const uint8_t*>(&one) == 1;
+}
+
+// True if the file starts with the magic of a binary file (the text files start with a digit or a blank)
+inline bool is_binary_file(const MappedFile& file, const char* magic) {
+    return file.size >= sizeof(BinaryHeader) && memcmp(file.data, magic, 4) == 0;
+}
+
+// Records of a binary file of record_size int32 per record (is_binary_file must be true for the file). 
+// Returns nullptr (after printing the reason) if the header doesn't match the size of the file
+inline const int32_t* binary_records(const MappedFile& file, int record_size, int64_t& number_records) {
+    BinaryHeader header;
+    memcpy(&header, file.data, sizeof(BinaryHeader));
+    if (!is_little_endian()) {
+        printf("Binary file %s can only be read on a little-endian host\n", file.path.c_str());
+        return nullptr;
+    }
+    if (header.version != BINARY_VERSION) {
+        printf("Binary file %s has version %d but only version %d is supported\n", file.path.c_str(), header.version, BINARY_VERSION);
+        return nullptr;
+    }
+    // The number of records is checked against the size of the file before the multiplication so a crafted header can't overflow it
+    size_t record_bytes = record_size * sizeof(int32_t);
+    if (header.number_records < 0 || (uint64_t) header.number_records > (file.size - sizeof(BinaryHeader)) / record_bytes
+            || file.size != sizeof(BinaryHeader) + (size_t) header.number_records * record_bytes) {
+        printf("Binary file %s has %lld records in its header but its size doesn't match\n", file.path.c_str(), (long long) header.number_records);
+        return nullptr;
+    }
+    number_records = header.number_records;
+    return reinterpret_cast<const int32_t*>(file.data + sizeof(BinaryHeader));
+}
+
+// Write the header of a binary file
+inline bool write_binary_header(FILE* out, const char* magic, int64_t number_records) {
+    BinaryHeader header;
+    memcpy(header.magic, magic, 4);
+    header.version = BINARY_VERSION;
+    header.number_records = number_records;
+    return fwrite(&header, sizeof(BinaryHeader), 1, out) == 1;
+}
+
+#endif